@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include "export.h"
+
+// Export throughput benchmark.
+// Fills a history store and streams all of it through export_http() into a socketpair that a
+// reader thread drains, once per format. Reports MB/sec of response body and rows/sec.
+// Usage: bench_export [rows] [repeats]
+
+typedef struct {
+    int fd;
+    uint64_t bytes;
+} Drain;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void* drain_main(void* arg) {
+    Drain* d = (Drain*)arg;
+    static char buf[1 << 20];
+    ssize_t n;
+    while ((n = read(d->fd, buf, sizeof(buf))) > 0) d->bytes += (uint64_t)n;
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? (size_t)atol(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 3;
+    if (rows < 1) rows = 1;
+    if (repeats < 1) repeats = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    History h;
+    if (history_init(&h, rows) != 0) {
+        fprintf(stderr, "history_init failed\n");
+        return 1;
+    }
+    HistorySample r;
+    uint64_t ts = history_now_ms() - rows;
+    for (size_t i = 0; i < rows; i++) {
+        memset(&r, 0, sizeof(r));
+        r.ts_ms = ts + i;
+        snprintf(r.sensor_id, sizeof(r.sensor_id), "tank-%zu", i % 64);
+        r.flow_lpm = (float)(i % 400) * 0.1f;
+        r.humidity_pct = 41.5f + (float)(i % 7);
+        r.temperature_c = 21.0f + (float)(i % 5) * 0.1f;
+        r.pressure_kpa = 101.3f;
+        r.alerts_mask = (uint32_t)(i % 11 == 0);
+        r.flowing = (uint32_t)(i & 1);
+        history_append_records(&h, &r, 1);
+    }
+
+    static const char* names[] = { "csv", "ndjson", "arrow" };
+    printf("format   rows        MB          MB/sec    rows/sec    chunks\n");
+    for (int f = EXPORT_CSV; f <= EXPORT_ARROW; f++) {
+        ExportQuery q = { 0, UINT64_MAX, (ExportFormat)f };
+        double best = 1e9;
+        ExportResult res;
+        for (int rep = 0; rep < repeats; rep++) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 1;
+            Drain d = { sv[1], 0 };
+            pthread_t th;
+            pthread_create(&th, NULL, drain_main, &d);
+            double t0 = now_s();
+            int rc = export_http(&h, &q, sv[0], NULL, &res);
+            close(sv[0]);
+            pthread_join(th, NULL);
+            double el = now_s() - t0;
+            close(sv[1]);
+            if (rc != 0) {
+                fprintf(stderr, "export failed\n");
+                return 1;
+            }
+            if (el < best) best = el;
+        }
+        printf("%-7s  %-10llu  %-10.1f  %-8.1f  %-10.0f  %llu\n", names[f], (unsigned long long)res.rows,
+               (double)res.bytes / 1e6, (double)res.bytes / best / 1e6, (double)res.rows / best,
+               (unsigned long long)res.chunks);
+    }
+    history_free(&h);
+    return 0;
+}
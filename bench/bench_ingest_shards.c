@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ingest.h"
+#include "devices.h"
+#include "state.h"
+#include "history.h"
+
+// Loopback scaling benchmark for listen-mode ingest.
+// For 1..N shards it starts the SO_REUSEPORT listeners on a free port, points a few
+// blasting clients per shard at it and reports samples/sec that reached the device slices.
+// History is on (default capacity), as in the gateway, so the shared history lock is measured.
+// Usage: bench_ingest_shards [max_shards] [seconds] [clients_per_shard]
+
+typedef struct {
+    int port;
+    int id;
+    double deadline;
+} ClientArgs;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void* client_main(void* arg) {
+    ClientArgs* a = (ClientArgs*)arg;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(a->port);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        close(fd);
+        return NULL;
+    }
+
+    // 64 packets per write, the same shape the simulator sends
+    char buf[64 * 160];
+    size_t len = 0;
+    for (int i = 0; i < 64; i++) {
+        len += (size_t)snprintf(buf + len, sizeof(buf) - len,
+            "{\"sensor_id\": \"dev-%d\", \"flow_lpm\": %d.25, \"humidity_pct\": 41.5, \"temperature_c\": 21.0, \"pressure_kpa\": 101.3, \"flowing\": true}\n",
+            a->id, i % 40);
+    }
+    while (now_s() < a->deadline) {
+        if (write(fd, buf, len) <= 0) break;
+    }
+    close(fd);
+    return NULL;
+}
+
+static double run(int shards, double seconds, int clients_per_shard) {
+    SharedState st;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_init(&st.mu, NULL);
+    st.mode = MODE_LISTEN;
+    st.nshards = shards;
+    st.ingest_port = 0;
+    if (state_init_slices(&st, shards) != 0 || state_init_history(&st, HISTORY_DEFAULT_CAPACITY) != 0 ||
+        ingest_start(&st) != 0) {
+        fprintf(stderr, "could not start %d shards\n", shards);
+        exit(1);
+    }
+
+    int nclients = shards * clients_per_shard;
+    pthread_t* th = calloc((size_t)nclients, sizeof(pthread_t));
+    ClientArgs* args = calloc((size_t)nclients, sizeof(ClientArgs));
+    double t0 = now_s();
+    for (int i = 0; i < nclients; i++) {
+        args[i].port = st.ingest_port;
+        args[i].id = i;
+        args[i].deadline = t0 + seconds;
+        pthread_create(&th[i], NULL, client_main, &args[i]);
+    }
+    for (int i = 0; i < nclients; i++) pthread_join(th[i], NULL);
+    ingest_stop(&st); // drains whatever the shards already read
+    double elapsed = now_s() - t0;
+
+    uint64_t samples = 0;
+    for (int i = 0; i < st.nslices; i++) samples += st.slices[i].samples;
+    free(th);
+    free(args);
+    free(st.slices);
+    history_free(st.history);
+    free(st.history);
+    return (double)samples / elapsed;
+}
+
+int main(int argc, char** argv) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_shards = argc > 1 ? atoi(argv[1]) : (ncpu > 0 ? (int)ncpu : 1);
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    int clients = argc > 3 ? atoi(argv[3]) : 4;
+    if (max_shards < 1) max_shards = 1;
+    if (max_shards > MAX_SHARDS) max_shards = MAX_SHARDS;
+
+    printf("shards  samples/sec  speedup\n");
+    double base = 0;
+    for (int s = 1; s <= max_shards; s++) {
+        double rate = run(s, seconds, clients);
+        if (s == 1) base = rate;
+        printf("%6d  %11.0f  %6.2fx\n", s, rate, base > 0 ? rate / base : 0.0);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "serialize.h"
+#include "sse_reference.h"
+
+// Frames/sec for the dashboard serializer: original snprintf formatter vs the table-driven one.
+// Usage: bench_serialize [frames]
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+#define VARIANTS 256
+
+int main(int argc, char** argv) {
+    long frames = argc > 1 ? atol(argv[1]) : 2000000;
+
+    // Pre-build varied readings so neither formatter benefits from repeating one value
+    SensorData* d = calloc(VARIANTS, sizeof(SensorData));
+    srand(7);
+    for (int i = 0; i < VARIANTS; i++) {
+        d[i].flow_lpm = (float)rand() / (float)RAND_MAX * 50.0f;
+        d[i].humidity_pct = (float)rand() / (float)RAND_MAX * 100.0f;
+        d[i].temperature_c = (float)rand() / (float)RAND_MAX * 70.0f - 10.0f;
+        d[i].pressure_kpa = 90.0f + (float)rand() / (float)RAND_MAX * 40.0f;
+        d[i].alerts_mask = (AlertFlags)(rand() & ALERT_MASK_ALL);
+        d[i].conn = CONN_CONNECTED;
+        d[i].last_seq = (uint64_t)i * 977;
+        snprintf(d[i].via, sizeof(d[i].via), "TCP");
+    }
+
+    char ref[1024];
+    char frame[SSE_FRAME_MAX + 8];
+    size_t sink = 0;
+
+    double t0 = now_s();
+    for (long i = 0; i < frames; i++) {
+        char json[384];
+        reference_json_for_current(&d[i % VARIANTS], json, sizeof(json));
+        sink += (size_t)snprintf(ref, sizeof(ref), "data: %s\n\n", json);
+    }
+    double t_ref = now_s() - t0;
+
+    t0 = now_s();
+    for (long i = 0; i < frames; i++) {
+        sink += sse_format_frame(&d[i % VARIANTS], frame, sizeof(frame));
+    }
+    double t_fast = now_s() - t0;
+
+    printf("snprintf formatter : %12.0f frames/sec\n", (double)frames / t_ref);
+    printf("table serializer   : %12.0f frames/sec  (%.1fx)\n", (double)frames / t_fast, t_ref / t_fast);
+    printf("(checksum %zu)\n", sink);
+    free(d);
+    return 0;
+}
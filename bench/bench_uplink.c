@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <signal.h>
+#include "ingest.h"
+#include "state.h"
+#include "uplink.h"
+
+// Loopback benchmark for gateway federation.
+// Starts an aggregator (listen mode, one shard per gateway) and N edge gateways in-process.
+// Each gateway publishes samples as fast as its uplink queue drains; the report shows what
+// reached the aggregator's device slices, the bytes on the wire and the edge-to-aggregator lag.
+// Usage: bench_uplink [gateways] [seconds] [sensors_per_gateway]
+
+typedef struct {
+    SharedState st;
+    int id;
+    int sensors;
+    double deadline;
+} Gateway;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void* gateway_main(void* arg) {
+    Gateway* g = (Gateway*)arg;
+    SensorData batch[64];
+    uint64_t i = 0;
+    while (now_s() < g->deadline) {
+        // Stay below the queue bound: the benchmark measures delivery, not drops
+        if (uplink_queued(g->st.uplink) > UPLINK_QUEUE_CAP / 2) { sched_yield(); continue; }
+        for (int k = 0; k < 64; k++, i++) {
+            SensorData* s = &batch[k];
+            memset(s, 0, sizeof(*s));
+            snprintf(s->sensor_id, sizeof(s->sensor_id), "gw%d-dev%d", g->id, (int)(i % (uint64_t)g->sensors));
+            s->flow_lpm = (float)(i % 40) + 0.25f;
+            s->humidity_pct = 41.5f;
+            s->temperature_c = 21.0f + (float)(i % 5) * 0.1f;
+            s->pressure_kpa = 101.3f;
+            s->flowing = true;
+            s->conn = CONN_CONNECTED;
+        }
+        state_publish_batch(&g->st, batch, 64);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int ngw = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    int sensors = argc > 3 ? atoi(argv[3]) : 16;
+    if (ngw < 1) ngw = 1;
+    if (ngw > MAX_SHARDS) ngw = MAX_SHARDS;
+    if (sensors < 1) sensors = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    SharedState agg;
+    memset(&agg, 0, sizeof(agg));
+    pthread_mutex_init(&agg.mu, NULL);
+    agg.mode = MODE_LISTEN;
+    agg.nshards = ngw;
+    agg.uplink_peers = uplink_peers_create();
+    if (state_init_slices(&agg, ngw) != 0 || ingest_start(&agg) != 0) {
+        fprintf(stderr, "aggregator did not start\n");
+        return 1;
+    }
+
+    Gateway* gws = calloc((size_t)ngw, sizeof(Gateway));
+    pthread_t* th = calloc((size_t)ngw, sizeof(pthread_t));
+    double t0 = now_s();
+    for (int i = 0; i < ngw; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "bench-gw-%d", i);
+        pthread_mutex_init(&gws[i].st.mu, NULL);
+        gws[i].st.uplink = uplink_start(&gws[i].st, "127.0.0.1", agg.ingest_port, id, "", UPLINK_SPILL_DEFAULT);
+        gws[i].id = i;
+        gws[i].sensors = sensors;
+        gws[i].deadline = t0 + seconds;
+        pthread_create(&th[i], NULL, gateway_main, &gws[i]);
+    }
+    for (int i = 0; i < ngw; i++) pthread_join(th[i], NULL);
+    for (int i = 0; i < ngw; i++) uplink_stop(gws[i].st.uplink); // flushes and waits for acks
+    double elapsed = now_s() - t0;
+    ingest_stop(&agg);
+
+    UplinkPeer* peers = calloc((size_t)ngw, sizeof(UplinkPeer));
+    int np = uplink_peers_snapshot(agg.uplink_peers, peers, ngw);
+    uint64_t samples = 0, bytes = 0, lag_max = 0;
+    double lag_avg = 0;
+    printf("gateway        samples     bytes/sample  lag avg ms  lag max ms\n");
+    for (int i = 0; i < np; i++) {
+        UplinkPeer* p = &peers[i];
+        printf("%-12s  %10llu  %12.2f  %10.1f  %10llu\n", p->id, (unsigned long long)p->samples,
+               p->samples ? (double)p->bytes / (double)p->samples : 0.0, p->lag_avg_ms,
+               (unsigned long long)p->lag_max_ms);
+        samples += p->samples;
+        bytes += p->bytes;
+        lag_avg += p->lag_avg_ms / np;
+        if (p->lag_max_ms > lag_max) lag_max = p->lag_max_ms;
+    }
+    printf("\n%d gateways: %.0f samples/sec, %.2f MB/sec on the wire (%.2f bytes/sample), lag avg %.1f ms, max %llu ms\n",
+           ngw, (double)samples / elapsed, (double)bytes / elapsed / 1e6,
+           samples ? (double)bytes / (double)samples : 0.0, lag_avg, (unsigned long long)lag_max);
+
+    free(peers);
+    free(th);
+    free(gws);
+    uplink_peers_free(agg.uplink_peers);
+    free(agg.slices);
+    return 0;
+}
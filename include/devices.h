@@ -0,0 +1,69 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+#include "shared.h"
+
+// Latest reading per device, keyed by SensorData.sensor_id.
+// The fleet is split into slices by a hash of the id (state_slice_of), so every device has one
+// owning table whichever shard its connection lands on, and shards rarely wait on each other's
+// lock; the HTTP side merges the slices when it needs the whole picture.
+
+#define MAX_DEVICES 256 // per slice
+#define STATS_EWMA_ALPHA 0.1f
+
+// Rolling statistics per device for flow, humidity, temperature, pressure (in that order)
+typedef struct {
+    uint64_t count;
+    float ewma[4];                    // exponential moving average, recent samples weigh most
+    float min[4];
+    float max[4];
+} RollingStats;
+
+// An alert edge seen while applying a batch: samples[index] changed the device's mask from prev_mask
+typedef struct {
+    int index;
+    AlertFlags prev_mask;
+    uint64_t seq;                     // the device's last_seq once samples[index] was applied
+} AlertTransition;
+
+// Open ingest connections currently speaking for one sensor_id
+typedef struct {
+    char id[32];
+    int n;
+} DeviceConnCount;
+
+typedef struct DeviceTable {
+    pthread_mutex_t mu;
+    int count;
+    uint64_t samples;                 // samples applied to this slice
+    uint64_t dropped;                 // samples for new devices while the slice was full of connected ones
+    SensorData devices[MAX_DEVICES];
+    RollingStats stats[MAX_DEVICES];
+    DeviceConnCount conns[MAX_DEVICES];
+    int nconns;
+} DeviceTable;
+
+// Implemented in src/devices.c
+void device_table_init(DeviceTable* t);
+// Upsert a batch of samples under one lock; each device keeps a per-device last_seq.
+// When the slice is full, a new device takes over the entry of a disconnected one.
+// If tr is not NULL, up to max_tr alert transitions (a sample whose alerts_mask differs from
+// the device's previous one; a new device starts from no alerts) are written there.
+// Returns the number of transitions found, which may exceed max_tr.
+int device_table_apply(DeviceTable* t, const SensorData* samples, int count, AlertTransition* tr, int max_tr);
+// Set a device's connection status (bumping its last_seq so streams notice). No-op if unknown.
+void device_table_set_conn(DeviceTable* t, const char* id, ConnectionStatus conn);
+// Count one more connection speaking for id. Returns -1 (uncounted) if the slice already tracks
+// MAX_DEVICES connected ids.
+int device_table_conn_open(DeviceTable* t, const char* id);
+// Drop one connection from id's count. When it was the last one (or was never counted) and
+// mark is set, the device is marked disconnected under the same lock, so a connection opened
+// for the id meanwhile always wins. Returns 1 if the device's status changed.
+int device_table_conn_close(DeviceTable* t, const char* id, int mark);
+// Copy one device out by id. Returns 0, or -1 if the table does not hold it.
+int device_table_get(DeviceTable* t, const char* id, SensorData* out);
+// Copy up to max devices (and their stats, if stats is not NULL) out. Returns the number copied.
+int device_table_copy(DeviceTable* t, SensorData* out, RollingStats* stats, int max);
+// Put devices back from a snapshot (existing entries with the same id are replaced).
+void device_table_restore(DeviceTable* t, const SensorData* devs, const RollingStats* stats, int count);
+
+#endif
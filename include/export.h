@@ -0,0 +1,51 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+#include <stddef.h>
+#include <stdint.h>
+#include "history.h"
+
+// Bulk export of the history store: GET /export?from=&to=&format=csv|ndjson|arrow
+// from/to are wall-clock milliseconds (from inclusive, to exclusive; either may be left out).
+// The response is streamed with Transfer-Encoding: chunked. The exporter copies the history in
+// fixed windows and formats each into one chunk buffer, so memory stays the same whatever the
+// range, and every chunk (size line, payload and CRLF) goes out in a single write().
+//
+// format=arrow is an Arrow IPC stream (application/vnd.apache.arrow.stream): a schema message,
+// one record batch per window and the end-of-stream marker. Columns: ts_ms timestamp[ms, UTC],
+// sensor_id utf8, flow_lpm/humidity_pct/temperature_c/pressure_kpa float32, alerts_mask uint32,
+// flowing bool. pyarrow.ipc.open_stream(...).read_pandas() loads it without parsing text.
+
+#define EXPORT_WINDOW 4096                  // history records copied per step (= rows per Arrow batch)
+#define EXPORT_CHUNK_MAX (320 * 1024)        // payload bytes per chunk; an Arrow batch fits one chunk
+#define EXPORT_ROW_MAX 1024                  // worst-case CSV/NDJSON row
+
+typedef enum {
+    EXPORT_CSV = 0,
+    EXPORT_NDJSON = 1,
+    EXPORT_ARROW = 2
+} ExportFormat;
+
+typedef struct {
+    uint64_t from_ms;                        // 0 = oldest retained
+    uint64_t to_ms;                          // UINT64_MAX = newest
+    ExportFormat format;
+} ExportQuery;
+
+typedef struct {
+    uint64_t rows;
+    uint64_t bytes;                          // body bytes, chunk framing included
+    uint64_t chunks;
+} ExportResult;
+
+// Implemented in src/export.c
+// Parse the query string (NULL = everything as CSV). Returns 0, or -1 for unknown formats,
+// malformed numbers or from > to.
+int export_parse_query(const char* query, ExportQuery* out);
+// Stream the matching records to fd as a complete HTTP response. stop (may be NULL) is polled
+// between chunks so shutdown is not held up by a slow client. res (may be NULL) receives counts.
+// Returns 0, or -1 if a write failed, memory could not be allocated or the export was cut short
+// (stop set, or records in range overwritten by ingest before they were read); a cut-short
+// response is left without its terminating chunk.
+int export_http(History* h, const ExportQuery* q, int fd, const atomic_int* stop, ExportResult* res);
+
+#endif
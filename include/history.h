@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stddef.h>
+#include "shared.h"
+
+// Recent samples from every device, oldest overwritten first.
+// Fixed-size records in one ring so appends never allocate and the whole store can be
+// dumped to (and restored from) a snapshot with plain copies.
+
+#define HISTORY_DEFAULT_CAPACITY 65536
+
+typedef struct {
+    uint64_t ts_ms;          // wall clock when the sample was published
+    char sensor_id[32];
+    float flow_lpm;
+    float humidity_pct;
+    float temperature_c;
+    float pressure_kpa;
+    uint32_t alerts_mask;
+    uint32_t flowing;
+} HistorySample;
+
+typedef struct History {
+    pthread_mutex_t mu;
+    size_t capacity;
+    uint64_t total;          // samples ever appended; ring slot = index % capacity
+    uint64_t last_ts;        // newest ts_ms appended; new stamps never go below it
+    HistorySample* ring;
+} History;
+
+// Implemented in src/history.c
+int history_init(History* h, size_t capacity);
+void history_free(History* h);
+// Append a batch under one lock, stamping every sample with the wall clock read inside the lock
+// and clamped to the newest stamp so far (shards racing for the lock, or the clock stepping
+// back, never make ts_ms go backwards). Returns the stamp used.
+uint64_t history_append_batch(History* h, const SensorData* samples, int count);
+// Append already-built records (snapshot restore); keeps their timestamps.
+void history_append_records(History* h, const HistorySample* recs, size_t count);
+// Copy up to max records starting at absolute index `from` (clamped to what is retained).
+// Returns the number copied and stores the index after the last one in *next.
+size_t history_copy(History* h, uint64_t from, HistorySample* out, size_t max, uint64_t* next);
+// Absolute index of the first retained record with ts_ms >= ts (binary search: appended
+// timestamps never decrease). *end receives the index one past the newest record.
+uint64_t history_seek(History* h, uint64_t ts_ms, uint64_t* end);
+// Wall clock in milliseconds (timestamps for history and snapshots)
+uint64_t history_now_ms(void);
+
+#endif
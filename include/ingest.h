@@ -0,0 +1,62 @@
+#ifndef INGEST_H
+#define INGEST_H
+#include <stdatomic.h>
+#include "shared.h"
+#include "pipeline.h"
+#include "uplink.h"
+
+// Listen-mode ingest: devices connect to the gateway instead of the gateway dialing a simulator.
+// The ingest port is opened once per shard with SO_REUSEPORT so the kernel spreads incoming
+// device connections across shard threads. Each shard owns its sockets and its line buffers;
+// a device's state lives in the slice that owns its sensor_id (state_slice_of), whichever shard
+// its connection lands on, so a reconnect never leaves a stale copy behind.
+// Shards still meet once per batch in state_publish_batch: the owning slices' locks, the global
+// history lock, the uplink and alert queues (when enabled) and the dashboard reading.
+// Edge gateways forwarding with --uplink connect to the same port; their connections are
+// recognised by the first bytes and their batches land in the same per-device slices.
+
+#define MAX_SHARDS 64
+#define SHARD_READ_BUF 16384
+
+typedef struct {
+    int fd;
+    size_t len;                  // bytes of a half-received line
+    char line[PIPE_MAX_LINE];
+    SensorData cur;              // previous reading from this connection (optional fields carry forward)
+    char counted[32];            // sensor_id this connection is counted for (state_device_conn_open)
+    int sniffed;                 // first bytes seen: JSON lines, or a gateway uplink
+    UplinkRx* up;                // set for gateway uplinks (binary batches, see uplink.h)
+} ShardConn;
+
+typedef struct IngestShard {
+    int id;
+    int listen_fd;
+    SharedState* st;
+    pthread_t th;
+    atomic_int stop;
+
+    ShardConn* conns;
+    int nconns;
+    int cap_conns;
+    SensorData batch[PIPE_BATCH_MAX];
+    int nbatch;
+    char rbuf[SHARD_READ_BUF];
+
+    atomic_int active;           // open device connections (read by other shards and /stats)
+    atomic_uint_fast64_t accepted;
+    atomic_uint_fast64_t lines;
+    atomic_uint_fast64_t parse_errors;
+} IngestShard;
+
+// Implemented in src/ingest.c
+// Opens st->nshards listeners on st->ingest_port and starts one thread per shard.
+// Port 0 picks a free port, written back to st->ingest_port. Returns 0 on success, -1 on failure
+// (a listener or shard thread that could not be had; nothing is left running then).
+int ingest_start(SharedState* st);
+// Stops and joins the shard threads and closes every socket they own. Frees st->shards, so
+// readers such as /stats must be gone first (main joins the HTTP thread before calling this).
+void ingest_stop(SharedState* st);
+// Per-shard counters as a JSON array.
+int ingest_stats_json(SharedState* st, char* out, size_t outsz);
+
+#endif
@@ -3,8 +3,11 @@
 #include "shared.h"
 
 // Parse a minimal JSON line with keys:
-// flow_lpm, humidity_pct, temperature_c (opt), pressure_kpa (opt), flowing.
+// flow_lpm, humidity_pct, temperature_c (opt), pressure_kpa (opt), flowing, sensor_id (opt).
 // Returns 0 on success, -1 on failure.
 int parse_sensor_json(const char* line, SensorData* out);
+// Ids (sensor_id, gateway uplink ids) are written unescaped into JSON, SSE and CSV output, so only
+// printable ASCII other than '"' and '\\' is accepted. Returns 1 if id is non-empty and valid.
+int sensor_id_valid(const char* id);
 
 #endif
@@ -0,0 +1,56 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+#include <stddef.h>
+#include "shared.h"
+#include "devices.h"
+
+// Alert notifications: every raise/clear of an alert bit is POSTed to external webhook receivers.
+// The device tables detect the edges while they apply a batch (device_table_apply), and
+// state_publish_batch hands them to notify_publish, which only copies them into a bounded queue.
+// A fan-out thread copies the queue into each destination's pending ring. Every destination has
+// its own worker thread, so a receiver that hangs delays only its own events; the worker sends up
+// to NOTIFY_BATCH_MAX events per request over a keep-alive connection and retries failed requests
+// with exponential backoff. A batch that still fails after max_attempts, or is still pending at
+// shutdown, is appended to the dead-letter file (one JSON line per event) instead of being lost
+// silently.
+//
+// Request body: { "gateway": "<id>", "events": [ { "sensor_id": .., "ts_ms": .., "raised": [..],
+//   "cleared": [..], "alerts": [..], "alerts_mask": N, "flow_lpm": .., ... }, ... ] }
+
+#define NOTIFY_QUEUE_CAP 4096             // events between ingest and the fan-out
+#define NOTIFY_DEST_PENDING 1024          // events waiting per destination
+#define NOTIFY_BATCH_MAX 64               // events per request
+#define NOTIFY_MAX_ATTEMPTS 6
+#define NOTIFY_BACKOFF_MS 250             // first retry delay, doubled per attempt
+#define NOTIFY_BACKOFF_MAX_MS 30000
+#define NOTIFY_IO_TIMEOUT_MS 2000         // connect, send and response timeout per request
+#define NOTIFY_TRANSITIONS_PER_BATCH 64   // edges kept per published batch; more are counted as dropped
+
+typedef struct {
+    char sensor_id[32];
+    AlertFlags prev_mask;
+    AlertFlags mask;
+    float flow_lpm;
+    float humidity_pct;
+    float temperature_c;
+    float pressure_kpa;
+    uint64_t ts_ms;                       // wall clock when detected (sent to the receiver)
+    uint64_t enq_us;                      // monotonic, for dispatch latency
+} AlertEvent;
+
+typedef struct Notifier Notifier;
+
+// Implemented in src/notify.c
+// Starts the fan-out and one worker per st->webhook_urls entry (http://host[:port][/path]).
+// Returns NULL if none of them parse or a thread cannot start.
+Notifier* notify_start(SharedState* st, int max_attempts, int backoff_ms);
+// Gives pending events a last chance (bounded by NOTIFY_IO_TIMEOUT_MS per destination, in
+// parallel), dead-letters the rest, then joins the threads and frees the notifier.
+void notify_stop(Notifier* n);
+// Ingest path: queue the transitions found in samples (ntr may exceed what tr holds; the
+// excess is counted as dropped). Never waits on the network.
+void notify_publish(Notifier* n, const SensorData* samples, const AlertTransition* tr, int ntr, uint64_t ts_ms);
+// Queue depth, delivery counters, dispatch latency and per-destination state as JSON.
+int notify_stats_json(Notifier* n, char* out, size_t outsz);
+
+#endif
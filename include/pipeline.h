@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stddef.h>
+#include <stdatomic.h>
+#include "shared.h"
+#include "spsc.h"
+
+// Staged TCP ingest: reader -> parser -> publisher.
+// The reader (the sensor thread) only frames bytes into batches of lines, so a slow parse or
+// a contended st->mu never stops it from draining the socket. Batches travel through two
+// lock-free SPSC rings and the publisher applies each batch with a single state update.
+
+#define PIPE_QUEUE_SLOTS 16          // batches in flight per ring
+#define PIPE_MAX_LINE 1024           // same line limit the single-thread reader had
+#define PIPE_BATCH_MAX 128           // lines (and samples) per batch
+#define PIPE_LINE_BATCH_BYTES 16384  // raw bytes per line batch
+#define PIPE_NO_EVENT (-1)
+
+typedef enum {
+    PIPE_STAGE_READER = 0,
+    PIPE_STAGE_PARSER = 1,
+    PIPE_STAGE_PUBLISHER = 2,
+    PIPE_STAGE_COUNT = 3
+} PipelineStage;
+
+// Raw lines handed from reader to parser (nul-terminated, packed back to back).
+typedef struct {
+    int count;
+    int conn_event;                  // ConnectionStatus to apply after the lines, or PIPE_NO_EVENT
+    size_t used;
+    uint16_t off[PIPE_BATCH_MAX];
+    char data[PIPE_LINE_BATCH_BYTES];
+} LineBatch;
+
+// Parsed samples handed from parser to publisher.
+typedef struct {
+    int count;
+    int conn_event;
+    SensorData samples[PIPE_BATCH_MAX];
+} SampleBatch;
+
+typedef struct IngestPipeline {
+    SharedState* st;
+    SpscRing lines;                  // reader -> parser
+    SpscRing samples;                // parser -> publisher
+    atomic_int stop;
+    pthread_t parser_th;
+    pthread_t publisher_th;
+
+    // Reader-owned framing state (only touched by the thread calling pipeline_feed)
+    LineBatch* cur;
+    char partial[PIPE_MAX_LINE];
+    size_t partial_len;
+
+    SensorData* parser_last;         // parser-owned: each device's last sample (see parser_line)
+
+    // Counters reported on /stats
+    atomic_uint_fast64_t lines_read;
+    atomic_uint_fast64_t samples_parsed;
+    atomic_uint_fast64_t parse_errors;
+    atomic_uint_fast64_t batches_published;
+    atomic_size_t line_depth_max;
+    atomic_size_t sample_depth_max;
+} IngestPipeline;
+
+// Implemented in src/pipeline.c
+// Starts the parser and publisher threads (pinned per st->pin_cores). Returns NULL if memory or
+// a thread could not be had (nothing is left running then).
+IngestPipeline* pipeline_start(SharedState* st);
+// Flushes pending lines, lets the stages drain, joins them and frees the pipeline.
+void pipeline_stop(IngestPipeline* p);
+
+// Reader side: frame raw socket bytes into line batches.
+void pipeline_feed(IngestPipeline* p, const char* buf, size_t n);
+// Hand the current (possibly partial) batch to the parser.
+void pipeline_flush(IngestPipeline* p);
+// Queue a connection change so it is applied in order with the samples around it.
+// Any half-received line is dropped, matching a fresh connection.
+void pipeline_conn_event(IngestPipeline* p, ConnectionStatus status);
+
+// Pin the calling thread to a core (Linux only); core < 0 leaves it unpinned.
+int pipeline_pin_self(int core);
+
+// Write the per-stage queue depths and counters as a JSON object.
+int pipeline_stats_json(IngestPipeline* p, char* out, size_t outsz);
+
+#endif
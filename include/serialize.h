@@ -0,0 +1,43 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+#include <stddef.h>
+#include "shared.h"
+
+// Allocation-free serializer for the dashboard payload.
+// Alert lists/summaries come from tables indexed by the 5-bit alert mask and numbers are
+// written by an integer routine, so a frame costs a handful of memcpy calls instead of a
+// large snprintf. Output is byte-identical to the original "%.2f" snprintf formatter.
+
+#define ALERT_MASK_ALL 0x1F    // every AlertFlags bit
+#define SSE_FRAME_MAX 1024     // worst case for one "data: {...}\n\n" frame
+
+// Implemented in src/serialize.c
+// Precomputed JSON array (e.g. ["HIGH_FLOW","LOW_FLOW"]) and human summary for a mask.
+const char* alert_list_json(AlertFlags mask, size_t* len);
+const char* alert_summary(AlertFlags mask, size_t* len);
+
+// Append v with exactly two decimals ("%.2f" rounding). Returns the new end pointer.
+// Needs room for 48 bytes.
+char* fmt_fixed2(char* p, float v);
+
+// Write the dashboard JSON object for d. cap must be at least SSE_FRAME_MAX.
+// Returns the number of bytes written (not nul-terminated), or 0 if cap is too small.
+size_t json_format_current(const SensorData* d, char* out, size_t cap);
+// Same object wrapped as one SSE frame: "data: <json>\n\n".
+size_t sse_format_frame(const SensorData* d, char* out, size_t cap);
+
+// Field groups a filtered subscriber can ask for (sensor_id and seq are always sent)
+#define FIELD_FLOW        (1u << 0)  // flow_lpm
+#define FIELD_HUMIDITY    (1u << 1)  // humidity_pct
+#define FIELD_TEMPERATURE (1u << 2)  // temperature_c
+#define FIELD_PRESSURE    (1u << 3)  // pressure_kpa
+#define FIELD_ALERTS      (1u << 4)  // alerts + alert_summary
+#define FIELD_CONNECTION  (1u << 5)  // connection + via
+#define FIELD_ALL         0x3Fu
+#define SSE_FILTERED_FRAME_MAX (SSE_FRAME_MAX + 64)
+
+// Per-device SSE frame with only the requested fields, in the same order and number format
+// as the dashboard payload. cap must be at least SSE_FILTERED_FRAME_MAX; returns bytes written.
+size_t sse_format_filtered(const SensorData* d, unsigned fields, char* out, size_t cap);
+
+#endif
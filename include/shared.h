@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdatomic.h>
 
 typedef enum {
     ALERTF_NONE = 0,
@@ -27,7 +28,8 @@ typedef struct {
     bool flowing;          // true/false (still tracked for compatibility)
     AlertFlags alerts_mask; // bitmask of active alerts
     ConnectionStatus conn; // connected or not
-    char via[16];          // "TCP" or "SIM"
+    char via[16];          // "TCP", "SIM", "LISTEN" or "UPLINK"
+    char sensor_id[32];    // device name from the packet (or its peer address)
     uint64_t last_seq;     // increment on update
 } SensorData;
 
@@ -38,13 +40,51 @@ typedef struct {
 #define TEMP_EMERGENCY_THRESHOLD 50.0f
 #define PRESSURE_EMERGENCY_THRESHOLD 120.0f
 
+#define MAX_WEBHOOKS 4                        // alert notification destinations
+
+struct IngestPipeline; // defined in pipeline.h
+struct IngestShard;    // defined in ingest.h
+struct DeviceTable;    // defined in devices.h
+struct History;        // defined in history.h
+struct Uplink;         // defined in uplink.h
+struct UplinkPeers;    // defined in uplink.h
+struct Notifier;       // defined in notify.h
+
+typedef enum {
+    MODE_SIM = 0,          // generate readings locally
+    MODE_TCP = 1,          // dial the simulator
+    MODE_LISTEN = 2        // devices dial us on ingest_port (sharded)
+} IngestMode;
+
 typedef struct {
     pthread_mutex_t mu;
     SensorData data;
-    int mode_tcp;          // 1=tcp, 0=sim
+    IngestMode mode;
     char tcp_host[64];
     int tcp_port;
     int web_port;
+    int pin_cores[3];      // reader/parser/publisher core, -1 = let the OS decide
+    struct IngestPipeline* pipeline; // set by the TCP sensor thread, read for /stats
+    int ingest_port;       // listen mode: port devices connect to
+    int nshards;           // listen mode: SO_REUSEPORT listener threads
+    struct IngestShard* shards;
+    struct DeviceTable* slices; // per-device state, split by sensor_id hash (one slice per shard)
+    int nslices;
+    struct History* history; // recent samples from every device
+    char snapshot_path[256]; // written on shutdown, mapped on startup ("" = off)
+    char uplink_host[64];  // aggregator to forward samples to
+    int uplink_port;       // 0 = this gateway does not forward
+    char uplink_id[32];    // gateway name: uplink hello and alert webhook payloads
+    char spill_path[256];  // uplink batches wait here while the aggregator is down ("" = memory only)
+    size_t spill_max;      // bytes
+    struct Uplink* uplink; // edge side, NULL unless uplink_port is set
+    struct UplinkPeers* uplink_peers; // aggregator side (listen mode): gateways forwarding to us
+    char webhook_urls[MAX_WEBHOOKS][256]; // alert transitions are POSTed here
+    int nwebhooks;
+    char dead_letter_path[256]; // alert events that could not be delivered ("" = log only)
+    struct Notifier* notify; // NULL unless webhooks are configured
+    struct SubHub* subs;   // filtered /events hub, fed by state_publish_batch (NULL in tools/tests)
+    atomic_int stop;       // set once on shutdown; every thread polls it
 } SharedState;
 
 #endif
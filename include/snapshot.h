@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include "shared.h"
+
+// Binary warm-start snapshot, written on shutdown and mapped on the next startup.
+// Layout (all native-endian, fixed-size records so restore is a few memcpy calls):
+//   SnapshotHeader
+//   SensorData     dashboard reading
+//   SensorData     devices[device_count]
+//   RollingStats   stats[device_count]
+//   HistorySample  history[history_count]   oldest first
+// The header records the record sizes, so a snapshot from a build with a different
+// struct layout is rejected instead of being misread.
+
+#define SNAPSHOT_MAGIC "AQGSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t sensor_size;
+    uint32_t stats_size;
+    uint32_t history_size;
+    uint32_t device_count;
+    uint64_t history_count;
+    uint64_t written_ms;
+    uint64_t checksum;     // FNV-1a over everything after the header
+} SnapshotHeader;
+
+// Implemented in src/snapshot.c
+// Write the current state to path (via a temp file + rename). Returns 0 on success, -1 on error.
+int snapshot_write(SharedState* st, const char* path);
+// Map path and restore it into st (dashboard, slice 0 devices, history). Live fields such as
+// the connection status are reset so the UI shows the data as stale until ingest resumes.
+// Returns 0 on success, -1 if the file is missing or not a valid snapshot.
+int snapshot_load(SharedState* st, const char* path);
+
+#endif
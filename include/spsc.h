@@ -0,0 +1,34 @@
+#ifndef SPSC_H
+#define SPSC_H
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Lock-free single-producer/single-consumer ring of fixed-size slots.
+// Exactly one thread may write and exactly one thread may read; no mutex is needed
+// because each side only ever moves its own index. Slots are handed out in place
+// (acquire -> fill/read -> commit/release) so batches are never copied twice.
+typedef struct {
+    _Alignas(64) atomic_size_t head; // next slot the consumer will read
+    _Alignas(64) atomic_size_t tail; // next slot the producer will write
+    _Alignas(64) size_t capacity;    // number of slots (power of two)
+    size_t slot_size;                // bytes per slot
+    unsigned char* slots;            // capacity * slot_size bytes
+} SpscRing;
+
+// Implemented in src/spsc.c
+// capacity is rounded up to a power of two. Returns 0 on success, -1 on allocation failure.
+int spsc_init(SpscRing* r, size_t capacity, size_t slot_size);
+void spsc_free(SpscRing* r);
+
+// Producer side: returns a free slot or NULL when the ring is full.
+void* spsc_acquire_write(SpscRing* r);
+void spsc_commit_write(SpscRing* r);
+
+// Consumer side: returns the oldest filled slot or NULL when the ring is empty.
+void* spsc_acquire_read(SpscRing* r);
+void spsc_release_read(SpscRing* r);
+
+// Number of filled slots; safe to call from any thread (approximate while both sides run).
+size_t spsc_depth(SpscRing* r);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef STATE_H
+#define STATE_H
+#include "shared.h"
+#include "devices.h"
+
+// Implemented in src/state.c
+// Every ingest path (TCP pipeline, SIM generator, listen shards) publishes through these helpers so
+// SharedState is always updated the same way: one lock per call, last_seq bumped once per sample.
+int state_init_slices(SharedState* st, int nslices);
+// The slice that owns a device (FNV-1a of the id). Stable for a given nslices.
+int state_slice_of(SharedState* st, const char* sensor_id);
+int state_init_history(SharedState* st, size_t capacity);
+void state_set_connection(SharedState* st, ConnectionStatus status, const char* via);
+// Samples go into their devices' owning slices and the history ring, then the newest one becomes
+// the dashboard reading. The updated ids and alert edges are pushed to the uplink, the webhook
+// queue and the filtered /events hub (whichever are running).
+void state_publish_batch(SharedState* st, const SensorData* samples, int count);
+// Listen mode: a connection starts speaking for sensor_id, or stops (closed: the connection went
+// away rather than switched to another id). The device is marked disconnected only when its
+// last connection closes, so id-less devices sharing an address, or a reconnect that lands on
+// another shard before the old connection's close is noticed, never mark a live device down.
+void state_device_conn_open(SharedState* st, const char* sensor_id);
+void state_device_conn_release(SharedState* st, const char* sensor_id, int closed);
+// One device from its owning slice. Returns 0, or -1 if no slice holds it.
+int state_device(SharedState* st, const char* sensor_id, SensorData* out);
+// Merged view over every slice: copies up to max devices (and stats, if not NULL). Each sensor_id
+// lives in exactly one slice. Returns how many were copied.
+int state_merged_devices(SharedState* st, SensorData* out, RollingStats* stats, int max);
+// True once shutdown has started
+int state_stopping(SharedState* st);
+
+#endif
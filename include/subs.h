@@ -0,0 +1,54 @@
+#ifndef SUBS_H
+#define SUBS_H
+#include <stddef.h>
+#include "shared.h"
+#include "devices.h"
+
+// Filtered SSE streams: /events?sensors=a,b&fields=pressure_kpa,alerts&alerts_only=1
+// Subscribers with the same (canonical) filter share one FilterGroup, and a per-sensor index
+// maps each sensor to the groups that want it. state_publish_batch pushes the ids it updated
+// and the alert edges it found; the hub looks up only those sensors, and each interested group
+// serializes the frame once so the same bytes go to every subscriber in that group.
+// Plain subscribers get the newest state of every updated device (several updates between two
+// passes coalesce); alerts_only subscribers get every edge in order, so an alert raised and
+// cleared in quick succession still shows up twice.
+
+#define SUB_MAX_SENSORS 8      // ids per filter
+#define SUB_IDLE_MS 250        // longest the hub sleeps without updates (keepalives, shutdown)
+#define SUB_KEEPALIVE_MS 2000  // comment frame to idle subscribers (same cadence as /events)
+#define SUB_ALERT_QUEUE 1024   // alert edges waiting for the hub; more are counted as dropped
+
+typedef struct {
+    char sensors[SUB_MAX_SENSORS][32]; // sorted; empty list = every sensor
+    int nsensors;
+    unsigned fields;                   // FIELD_* bits from serialize.h
+    int alerts_only;                   // only send when a device's alert mask changes
+} SubFilter;
+
+typedef struct SubHub SubHub;
+
+// Implemented in src/subs.c
+// Parse a query string ("sensors=..&fields=..&alerts_only=1"). Returns 1 if it asked for
+// any filtering, 0 for a plain /events request, -1 for an unknown field or too many sensors.
+int subs_parse_filter(const char* query, SubFilter* out);
+
+SubHub* subs_create(SharedState* st);
+// Closes every subscriber socket and frees the hub (the hub thread and every publisher must
+// have exited).
+void subs_destroy(SubHub* hub);
+// Hand a connected client (SSE headers already sent) to the hub; the hub owns fd from now on.
+int subs_add(SubHub* hub, int fd, const SubFilter* f);
+// Ingest path (state_publish_batch): note the updated devices and queue the alert edges
+// (ntr may exceed what tr holds, as for notify_publish). Only a lock and a few copies; returns
+// at once while nobody is subscribed.
+void subs_publish(SubHub* hub, const SensorData* samples, int count, const AlertTransition* tr, int ntr);
+// A device changed outside a batch (its connection went away).
+void subs_device_changed(SubHub* hub, const char* sensor_id);
+// One pass: prime new subscribers and send frames for what was published since the last pass.
+void subs_tick(SubHub* hub);
+// Thread body: runs a pass whenever something is published (or every SUB_IDLE_MS) until
+// st->stop is set.
+void* subs_thread(void* hub);
+int subs_stats_json(SubHub* hub, char* out, size_t outsz);
+
+#endif
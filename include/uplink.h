@@ -0,0 +1,123 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+#include <stddef.h>
+#include <stdatomic.h>
+#include "shared.h"
+
+// Gateway federation: an edge gateway forwards every sample it publishes to an upstream
+// aggregator (which runs --mode listen) over one persistent TCP connection.
+//
+// Wire protocol (little-endian), sharing the aggregator's ingest port with JSON devices:
+//   edge -> aggregator  "AQH1" u8 id_len, id[id_len], u64 session      once per connection
+//   edge -> aggregator  "AQB2" u32 len, u64 seq, u32 count, payload    one compressed batch
+//   aggregator -> edge  "AQK1" u64 seq                                 cumulative ack
+// Sequence numbers keep increasing across reconnects within a session, so the aggregator can
+// drop batches it already applied when unacked ones are resent. While the upstream is down,
+// batches go to a bounded spill file and are replayed in order after reconnecting.
+// Delivery is exactly-once per session (edge process lifetime) and at-least-once across
+// edge restarts: batches spilled at shutdown are resent under the next session's numbers.
+//
+// Payload compression: sensor ids are sent once per batch in a small table, timestamps as
+// zig-zag varint deltas. Readings are lossless: a sample whose four readings are all exact
+// hundredths (what devices send) carries zig-zag varint deltas of the hundredths against the
+// previous sample of the same sensor; any other sample carries deltas of the float32 bit
+// patterns. Both decode to the identical float, so the forwarded alerts_mask always agrees
+// with the readings it was computed from. Typical samples take ~10 bytes instead of ~120 as JSON.
+
+#define UPLINK_MAGIC_HELLO "AQH1"
+#define UPLINK_MAGIC_BATCH "AQB1"
+#define UPLINK_MAGIC_ACK "AQK1"
+#define UPLINK_BATCH_HDR 20          // magic + len + seq + count
+#define UPLINK_ACK_LEN 12            // magic + cumulative seq
+#define UPLINK_BATCH_MAX 512         // samples per batch
+#define UPLINK_PAYLOAD_MAX (64 * 1024)
+#define UPLINK_QUEUE_CAP 65536       // samples buffered in memory on the edge
+#define UPLINK_WINDOW 32             // batches in flight before waiting for acks
+#define UPLINK_FLUSH_MS 50           // send a partial batch once its oldest sample is this old
+#define UPLINK_SPILL_DEFAULT (64u * 1024u * 1024u)
+#define UPLINK_MAX_PEERS 256
+
+typedef struct {
+    uint64_t ts_ms;                  // when the edge published it (used for lag)
+    SensorData s;
+} UplinkSample;
+
+// ---- codec (pure functions, used by both sides) ----
+
+// Encode up to n samples. At most 255 distinct sensors fit one batch, so fewer may be taken:
+// *consumed says how many. Returns payload bytes, or 0 if cap is too small.
+size_t uplink_encode(const UplinkSample* in, int n, unsigned char* out, size_t cap, int* consumed);
+// Decode a payload. Returns the sample count, or -1 if the payload is malformed or has more than max.
+int uplink_decode(const unsigned char* in, size_t len, UplinkSample* out, int max);
+
+// ---- edge side ----
+
+typedef struct Uplink Uplink;
+
+// Implemented in src/uplink.c
+// Starts the sender thread. spill_path may be "" to disable spilling (batches are then dropped
+// while the upstream is down). Returns NULL on failure.
+Uplink* uplink_start(SharedState* st, const char* host, int port, const char* edge_id,
+                     const char* spill_path, size_t spill_max);
+// Flushes what it can (or spills it), then joins the sender thread and frees the uplink.
+void uplink_stop(Uplink* up);
+// Called from state_publish_batch on the ingest path; never blocks on the network.
+void uplink_enqueue(Uplink* up, const SensorData* samples, int count, uint64_t ts_ms);
+// Samples waiting in memory (not yet encoded into a batch).
+size_t uplink_queued(Uplink* up);
+int uplink_stats_json(Uplink* up, char* out, size_t outsz);
+
+// ---- aggregator side ----
+
+// Per-connection receive state, owned by the ingest shard that accepted the connection.
+typedef struct {
+    unsigned char* buf;
+    size_t len;
+    size_t cap;
+    int peer;                        // index into the peer registry, -1 until the hello arrives
+    char id[32];                     // the edge's uplink id, prefixed to its sensor ids
+    UplinkSample* scratch;
+    SensorData* samples;
+    unsigned char ack[UPLINK_ACK_LEN]; // ack frame the socket has not taken in full yet
+    size_t ack_off;
+    size_t ack_len;
+    uint64_t ack_next;               // newer cumulative ack to send after it (0: none)
+} UplinkRx;
+
+// One entry per edge gateway id that ever connected.
+typedef struct {
+    char id[32];
+    uint64_t session;                // edge start time; a new one resets last_seq
+    uint64_t last_seq;               // highest batch applied in this session
+    int connections;                 // open uplink connections from this edge
+    uint64_t batches;
+    uint64_t samples;
+    uint64_t bytes;                  // wire bytes of applied batches
+    uint64_t duplicates;             // resent batches that were already applied
+    uint64_t lag_ms;                 // publish-on-edge to apply-here, newest batch
+    uint64_t lag_max_ms;
+    double lag_avg_ms;               // EWMA over batches
+} UplinkPeer;
+
+typedef struct UplinkPeers UplinkPeers;
+
+UplinkPeers* uplink_peers_create(void);
+void uplink_peers_free(UplinkPeers* peers);
+// Copies up to max peers; returns how many.
+int uplink_peers_snapshot(UplinkPeers* peers, UplinkPeer* out, int max);
+int uplink_peers_stats_json(UplinkPeers* peers, char* out, size_t outsz);
+
+// Consume bytes from an uplink connection: applies complete batches to the device slices
+// and acks them on fd without blocking (what the socket cannot take waits for
+// uplink_rx_flush). Devices are named "<uplink id>/<sensor_id>" on the aggregator, so edges
+// whose devices share an id (TCP and SIM mode both report "default") stay apart; a name that
+// would not fit 31 bytes keeps its start and ends in a hash of the whole name. Returns -1 on a protocol error (the shard then closes the connection).
+int uplink_rx_feed(SharedState* st, int shard, UplinkRx* rx, int fd, const char* data, size_t n);
+// Writes the queued ack once fd is writable. Returns -1 if the connection failed.
+int uplink_rx_flush(UplinkRx* rx, int fd);
+// Nonzero while an ack is queued: the shard then polls the connection for POLLOUT too.
+int uplink_rx_want_write(const UplinkRx* rx);
+// Releases the receive state when its connection closes.
+void uplink_rx_close(SharedState* st, UplinkRx* rx);
+
+#endif
@@ -0,0 +1,151 @@
+#include <string.h>
+#include "devices.h"
+
+// Per-slice device registry. A linear scan is plenty for a few hundred devices and keeps
+// the table a flat array that snapshots and the HTTP side can copy in one go.
+
+void device_table_init(DeviceTable* t) {
+    memset(t, 0, sizeof(*t));
+    pthread_mutex_init(&t->mu, NULL);
+}
+
+static int find_device(DeviceTable* t, const char* id) {
+    for (int i = 0; i < t->count; i++) {
+        if (strcmp(t->devices[i].sensor_id, id) == 0) return i;
+    }
+    return -1;
+}
+
+// A full slice makes room by reusing the entry of a device that has gone away
+static int find_disconnected(DeviceTable* t) {
+    for (int i = 0; i < t->count; i++) {
+        if (t->devices[i].conn != CONN_CONNECTED) return i;
+    }
+    return -1;
+}
+
+static void stats_update(RollingStats* rs, const SensorData* s) {
+    float v[4] = { s->flow_lpm, s->humidity_pct, s->temperature_c, s->pressure_kpa };
+    for (int k = 0; k < 4; k++) {
+        if (rs->count == 0) {
+            rs->ewma[k] = rs->min[k] = rs->max[k] = v[k];
+            continue;
+        }
+        rs->ewma[k] += STATS_EWMA_ALPHA * (v[k] - rs->ewma[k]);
+        if (v[k] < rs->min[k]) rs->min[k] = v[k];
+        if (v[k] > rs->max[k]) rs->max[k] = v[k];
+    }
+    rs->count++;
+}
+
+int device_table_apply(DeviceTable* t, const SensorData* samples, int count, AlertTransition* tr, int max_tr) {
+    pthread_mutex_lock(&t->mu);
+    int applied = 0;
+    int ntr = 0;
+    int hint = -1; // batches usually come from one device, so check the last hit first
+    for (int i = 0; i < count; i++) {
+        const SensorData* s = &samples[i];
+        int idx = (hint >= 0 && strcmp(t->devices[hint].sensor_id, s->sensor_id) == 0)
+                      ? hint : find_device(t, s->sensor_id);
+        if (idx < 0) {
+            idx = t->count < MAX_DEVICES ? t->count++ : find_disconnected(t);
+            if (idx < 0) { t->dropped++; continue; }
+            t->devices[idx].last_seq = 0;
+            t->devices[idx].alerts_mask = ALERTF_NONE;
+            memset(&t->stats[idx], 0, sizeof(t->stats[idx]));
+        }
+        // Edge-triggered: only a change of the mask is an alert event, not every sample that carries it
+        if (tr && t->devices[idx].alerts_mask != s->alerts_mask) {
+            if (ntr < max_tr) {
+                tr[ntr].index = i;
+                tr[ntr].prev_mask = t->devices[idx].alerts_mask;
+                tr[ntr].seq = t->devices[idx].last_seq + 1;
+            }
+            ntr++;
+        }
+        uint64_t seq = t->devices[idx].last_seq;
+        t->devices[idx] = *s;
+        t->devices[idx].last_seq = seq + 1;
+        stats_update(&t->stats[idx], s);
+        hint = idx;
+        applied++;
+    }
+    t->samples += (uint64_t)applied;
+    pthread_mutex_unlock(&t->mu);
+    return ntr;
+}
+
+static int set_conn_locked(DeviceTable* t, const char* id, ConnectionStatus conn) {
+    int idx = find_device(t, id);
+    if (idx < 0 || t->devices[idx].conn == conn) return 0;
+    t->devices[idx].conn = conn;
+    t->devices[idx].last_seq++;
+    return 1;
+}
+
+void device_table_set_conn(DeviceTable* t, const char* id, ConnectionStatus conn) {
+    pthread_mutex_lock(&t->mu);
+    set_conn_locked(t, id, conn);
+    pthread_mutex_unlock(&t->mu);
+}
+
+static int find_conn(DeviceTable* t, const char* id) {
+    for (int i = 0; i < t->nconns; i++) {
+        if (strcmp(t->conns[i].id, id) == 0) return i;
+    }
+    return -1;
+}
+
+int device_table_conn_open(DeviceTable* t, const char* id) {
+    pthread_mutex_lock(&t->mu);
+    int i = find_conn(t, id);
+    if (i < 0 && t->nconns < MAX_DEVICES) {
+        i = t->nconns++;
+        memcpy(t->conns[i].id, id, sizeof(t->conns[i].id));
+        t->conns[i].n = 0;
+    }
+    if (i >= 0) t->conns[i].n++;
+    pthread_mutex_unlock(&t->mu);
+    return i >= 0 ? 0 : -1;
+}
+
+int device_table_conn_close(DeviceTable* t, const char* id, int mark) {
+    pthread_mutex_lock(&t->mu);
+    int i = find_conn(t, id);
+    int last = i < 0 || --t->conns[i].n == 0;
+    if (i >= 0 && last) t->conns[i] = t->conns[--t->nconns];
+    int changed = last && mark && set_conn_locked(t, id, CONN_DISCONNECTED);
+    pthread_mutex_unlock(&t->mu);
+    return changed;
+}
+
+int device_table_get(DeviceTable* t, const char* id, SensorData* out) {
+    pthread_mutex_lock(&t->mu);
+    int idx = find_device(t, id);
+    if (idx >= 0) *out = t->devices[idx];
+    pthread_mutex_unlock(&t->mu);
+    return idx >= 0 ? 0 : -1;
+}
+
+int device_table_copy(DeviceTable* t, SensorData* out, RollingStats* stats, int max) {
+    pthread_mutex_lock(&t->mu);
+    int n = t->count < max ? t->count : max;
+    memcpy(out, t->devices, (size_t)n * sizeof(SensorData));
+    if (stats) memcpy(stats, t->stats, (size_t)n * sizeof(RollingStats));
+    pthread_mutex_unlock(&t->mu);
+    return n;
+}
+
+void device_table_restore(DeviceTable* t, const SensorData* devs, const RollingStats* stats, int count) {
+    pthread_mutex_lock(&t->mu);
+    for (int i = 0; i < count; i++) {
+        int idx = find_device(t, devs[i].sensor_id);
+        if (idx < 0) {
+            if (t->count == MAX_DEVICES) break;
+            idx = t->count++;
+        }
+        t->devices[idx] = devs[i];
+        t->stats[idx] = stats[i];
+    }
+    pthread_mutex_unlock(&t->mu);
+}
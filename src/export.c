@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include "export.h"
+#include "serialize.h"
+
+// Streaming /export (see export.h).
+// Per request: one window of EXPORT_WINDOW history records and one chunk buffer, both allocated
+// up front. The history lock is only held while a window is copied, never while writing.
+
+#define CHUNK_HDR 10                 // room in front of the payload for the "<hex size>\r\n" line
+#define CHUNK_TAIL 7                 // "\r\n" after the payload, plus "0\r\n\r\n" on the last one
+
+typedef struct {
+    int fd;
+    char* buf;                       // CHUNK_HDR + EXPORT_CHUNK_MAX + CHUNK_TAIL bytes
+    size_t len;                      // payload bytes waiting
+    ExportResult* res;
+    int failed;
+} ChunkOut;
+
+static int write_all(int fd, const char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static char* chunk_payload(ChunkOut* c) {
+    return c->buf + CHUNK_HDR;
+}
+
+// Frame the pending payload as one HTTP chunk (plus the terminating chunk when last is set)
+// and send it with a single write.
+static void chunk_emit(ChunkOut* c, int last) {
+    char* payload = chunk_payload(c);
+    char* start = payload;
+    size_t tail = 0;
+    if (c->len > 0) {
+        char hdr[CHUNK_HDR + 1];
+        int hl = snprintf(hdr, sizeof(hdr), "%zx\r\n", c->len);
+        start -= hl;
+        memcpy(start, hdr, (size_t)hl);
+        memcpy(payload + c->len, "\r\n", 2);
+        tail = 2;
+    }
+    if (last) {
+        memcpy(payload + c->len + tail, "0\r\n\r\n", 5);
+        tail += 5;
+    }
+    size_t total = (size_t)(payload - start) + c->len + tail;
+    if (total > 0 && !c->failed) {
+        if (write_all(c->fd, start, total) != 0) c->failed = 1;
+        c->res->bytes += total;
+        if (c->len > 0) c->res->chunks++;
+    }
+    c->len = 0;
+}
+
+// ---------- CSV / NDJSON rows ----------
+
+static char* put_u64(char* p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static char* put_lit(char* p, const char* s, size_t n) {
+    memcpy(p, s, n);
+    return p + n;
+}
+#define PUT_LIT(p, s) put_lit((p), (s), sizeof(s) - 1)
+
+// Readings as "%.2f"; non-finite values have no CSV/JSON spelling, so they become empty/null
+static char* put_reading(char* p, float v, int json) {
+    if (isfinite(v)) return fmt_fixed2(p, v);
+    return json ? PUT_LIT(p, "null") : p;
+}
+
+static char* put_csv_id(char* p, const char* id) {
+    size_t n = strnlen(id, 31);
+    if (strcspn(id, ",\"\r\n") >= n) return put_lit(p, id, n);
+    *p++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        if (id[i] == '"') *p++ = '"';
+        *p++ = id[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+static char* put_json_id(char* p, const char* id) {
+    static const char hex[] = "0123456789abcdef";
+    *p++ = '"';
+    for (size_t i = 0; i < 31 && id[i]; i++) {
+        unsigned char ch = (unsigned char)id[i];
+        if (ch == '"' || ch == '\\') {
+            *p++ = '\\';
+            *p++ = (char)ch;
+        } else if (ch < 0x20) {
+            p = PUT_LIT(p, "\\u00");
+            *p++ = hex[ch >> 4];
+            *p++ = hex[ch & 15];
+        } else {
+            *p++ = (char)ch;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+static const char CSV_HEADER[] = "ts_ms,sensor_id,flow_lpm,humidity_pct,temperature_c,pressure_kpa,alerts_mask,flowing\n";
+
+static size_t format_csv(const HistorySample* r, char* out) {
+    char* p = put_u64(out, r->ts_ms);
+    *p++ = ',';
+    p = put_csv_id(p, r->sensor_id);
+    *p++ = ',';
+    p = put_reading(p, r->flow_lpm, 0);
+    *p++ = ',';
+    p = put_reading(p, r->humidity_pct, 0);
+    *p++ = ',';
+    p = put_reading(p, r->temperature_c, 0);
+    *p++ = ',';
+    p = put_reading(p, r->pressure_kpa, 0);
+    *p++ = ',';
+    p = put_u64(p, r->alerts_mask);
+    *p++ = ',';
+    *p++ = r->flowing ? '1' : '0';
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+static size_t format_ndjson(const HistorySample* r, char* out) {
+    char* p = PUT_LIT(out, "{\"ts_ms\":");
+    p = put_u64(p, r->ts_ms);
+    p = PUT_LIT(p, ",\"sensor_id\":");
+    p = put_json_id(p, r->sensor_id);
+    p = PUT_LIT(p, ",\"flow_lpm\":");
+    p = put_reading(p, r->flow_lpm, 1);
+    p = PUT_LIT(p, ",\"humidity_pct\":");
+    p = put_reading(p, r->humidity_pct, 1);
+    p = PUT_LIT(p, ",\"temperature_c\":");
+    p = put_reading(p, r->temperature_c, 1);
+    p = PUT_LIT(p, ",\"pressure_kpa\":");
+    p = put_reading(p, r->pressure_kpa, 1);
+    p = PUT_LIT(p, ",\"alerts_mask\":");
+    p = put_u64(p, r->alerts_mask);
+    p = r->flowing ? PUT_LIT(p, ",\"flowing\":true}\n") : PUT_LIT(p, ",\"flowing\":false}\n");
+    return (size_t)(p - out);
+}
+
+// ---------- Arrow IPC ----------
+// Arrow metadata is a FlatBuffers "Message" table. The few tables needed here are laid out by
+// hand, front to back: every table is preceded by its vtable and every table, vector or string
+// a table points to is written after it (FlatBuffers offsets only point forward).
+
+enum {
+    ARROW_HEADER_SCHEMA = 1,
+    ARROW_HEADER_RECORD_BATCH = 3,
+    ARROW_METADATA_V5 = 4,
+    ARROW_TYPE_INT = 2,
+    ARROW_TYPE_FLOAT = 3,
+    ARROW_TYPE_UTF8 = 5,
+    ARROW_TYPE_BOOL = 6,
+    ARROW_TYPE_TIMESTAMP = 10,
+    ARROW_NCOLUMNS = 8,
+    ARROW_NBUFFERS = 17            // validity + data per column, plus offsets for sensor_id
+};
+
+typedef struct {
+    const char* name;
+    unsigned char type;
+} ArrowColumn;
+
+static const ArrowColumn ARROW_COLUMNS[ARROW_NCOLUMNS] = {
+    { "ts_ms", ARROW_TYPE_TIMESTAMP },
+    { "sensor_id", ARROW_TYPE_UTF8 },
+    { "flow_lpm", ARROW_TYPE_FLOAT },
+    { "humidity_pct", ARROW_TYPE_FLOAT },
+    { "temperature_c", ARROW_TYPE_FLOAT },
+    { "pressure_kpa", ARROW_TYPE_FLOAT },
+    { "alerts_mask", ARROW_TYPE_INT },
+    { "flowing", ARROW_TYPE_BOOL },
+};
+
+typedef struct {
+    unsigned char* p;
+    size_t len;
+    size_t cap;
+    int overflow;
+} Fb;
+
+static const unsigned char ZEROS[64];
+
+static void fb_bytes(Fb* b, const void* v, size_t n) {
+    if (b->overflow || b->len + n > b->cap) { b->overflow = 1; return; }
+    memcpy(b->p + b->len, v, n);
+    b->len += n;
+}
+
+static void fb_pad(Fb* b, size_t align) {
+    size_t rem = b->len % align;
+    if (rem) fb_bytes(b, ZEROS, align - rem);
+}
+
+// Little-endian scalar at an absolute position
+static void fb_set(Fb* b, size_t pos, uint64_t v, size_t n) {
+    if (b->overflow || pos + n > b->len) return;
+    for (size_t i = 0; i < n; i++) b->p[pos + i] = (unsigned char)(v >> (8 * i));
+}
+
+// uoffset stored at `field` pointing at `target` (which lies after it)
+static void fb_ref(Fb* b, size_t field, size_t target) {
+    fb_set(b, field, target - field, 4);
+}
+
+// Write a vtable and a zeroed table with fields of the given sizes (0 = absent), each at its
+// natural alignment. pos[i] receives the absolute position of field i. Returns the table.
+static size_t fb_table(Fb* b, int nfields, const unsigned char* sizes, size_t* pos) {
+    unsigned char vt[4 + 2 * 8];
+    size_t inl = 4; // the table starts with its soffset to the vtable
+    for (int i = 0; i < nfields; i++) {
+        size_t off = 0;
+        if (sizes[i]) {
+            inl = (inl + sizes[i] - 1) / sizes[i] * sizes[i];
+            off = inl;
+            inl += sizes[i];
+        }
+        vt[4 + 2 * i] = (unsigned char)off;
+        vt[5 + 2 * i] = (unsigned char)(off >> 8);
+    }
+    size_t vtsize = 4 + 2 * (size_t)nfields;
+    vt[0] = (unsigned char)vtsize;
+    vt[1] = 0;
+    vt[2] = (unsigned char)inl;
+    vt[3] = (unsigned char)(inl >> 8);
+
+    fb_pad(b, 2);
+    size_t vpos = b->len;
+    fb_bytes(b, vt, vtsize);
+    fb_pad(b, 8);
+    size_t t = b->len;
+    fb_bytes(b, ZEROS, inl);
+    fb_set(b, t, t - vpos, 4);
+    for (int i = 0; i < nfields; i++) {
+        pos[i] = t + (size_t)(vt[4 + 2 * i] | (vt[5 + 2 * i] << 8));
+    }
+    return t;
+}
+
+// Vector header (u32 count) followed by zeroed elements aligned to `align`. Returns the header.
+static size_t fb_vector(Fb* b, size_t count, size_t elem, size_t align) {
+    fb_pad(b, 4);
+    if (align > 4 && (b->len + 4) % align) fb_bytes(b, ZEROS, 4);
+    size_t v = b->len;
+    unsigned char n[4] = { (unsigned char)count, (unsigned char)(count >> 8), (unsigned char)(count >> 16), (unsigned char)(count >> 24) };
+    fb_bytes(b, n, 4);
+    for (size_t left = count * elem; left > 0;) {
+        size_t k = left < sizeof(ZEROS) ? left : sizeof(ZEROS);
+        fb_bytes(b, ZEROS, k);
+        left -= k;
+    }
+    return v;
+}
+
+static size_t fb_string(Fb* b, const char* s) {
+    size_t n = strlen(s);
+    size_t v = fb_vector(b, n, 1, 4);
+    if (!b->overflow) memcpy(b->p + v + 4, s, n);
+    fb_bytes(b, ZEROS, 1);
+    return v;
+}
+
+// Message { version, header_type, header, bodyLength } as the root table; returns the header field
+static size_t fb_message(Fb* b, unsigned char header_type, uint64_t body_len) {
+    static const unsigned char sizes[4] = { 2, 1, 4, 8 };
+    size_t pos[4];
+    fb_bytes(b, ZEROS, 4); // root offset
+    size_t msg = fb_table(b, 4, sizes, pos);
+    fb_set(b, 0, msg, 4);
+    fb_set(b, pos[0], ARROW_METADATA_V5, 2);
+    fb_set(b, pos[1], header_type, 1);
+    fb_set(b, pos[3], body_len, 8);
+    return pos[2];
+}
+
+static size_t fb_type(Fb* b, unsigned char type) {
+    size_t pos[2];
+    switch (type) {
+    case ARROW_TYPE_TIMESTAMP: {
+        static const unsigned char sizes[2] = { 2, 4 }; // unit, timezone
+        size_t t = fb_table(b, 2, sizes, pos);
+        fb_set(b, pos[0], 1, 2); // MILLISECOND
+        fb_ref(b, pos[1], fb_string(b, "UTC"));
+        return t;
+    }
+    case ARROW_TYPE_FLOAT: {
+        static const unsigned char sizes[1] = { 2 }; // precision
+        size_t t = fb_table(b, 1, sizes, pos);
+        fb_set(b, pos[0], 1, 2); // SINGLE
+        return t;
+    }
+    case ARROW_TYPE_INT: {
+        static const unsigned char sizes[2] = { 4, 1 }; // bitWidth, is_signed
+        size_t t = fb_table(b, 2, sizes, pos);
+        fb_set(b, pos[0], 32, 4);
+        return t;
+    }
+    default: // Utf8 and Bool have no fields
+        return fb_table(b, 0, NULL, pos);
+    }
+}
+
+// Continuation marker + metadata length in front of a finished flatbuffer.
+// Returns the encapsulated message size before the body, or 0 on overflow.
+static size_t arrow_encapsulate(unsigned char* out, Fb* b) {
+    fb_pad(b, 8);
+    if (b->overflow) return 0;
+    static const unsigned char cont[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    memcpy(out, cont, 4);
+    for (int i = 0; i < 4; i++) out[4 + i] = (unsigned char)(b->len >> (8 * i));
+    return 8 + b->len;
+}
+
+static int host_is_big_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 0;
+}
+
+static size_t arrow_schema(unsigned char* out, size_t cap) {
+    if (cap < 8) return 0;
+    Fb b = { out + 8, 0, cap - 8, 0 };
+    size_t header = fb_message(&b, ARROW_HEADER_SCHEMA, 0);
+
+    static const unsigned char schema_sizes[2] = { 2, 4 }; // endianness, fields
+    size_t spos[2];
+    size_t schema = fb_table(&b, 2, schema_sizes, spos);
+    fb_ref(&b, header, schema);
+    fb_set(&b, spos[0], host_is_big_endian() ? 1 : 0, 2); // buffers are written in host order
+    size_t fields = fb_vector(&b, ARROW_NCOLUMNS, 4, 4);
+    fb_ref(&b, spos[1], fields);
+
+    for (int i = 0; i < ARROW_NCOLUMNS; i++) {
+        // Field { name, nullable, type_type, type, dictionary, children }
+        static const unsigned char field_sizes[6] = { 4, 1, 1, 4, 0, 4 };
+        size_t fpos[6];
+        size_t field = fb_table(&b, 6, field_sizes, fpos);
+        fb_ref(&b, fields + 4 + 4 * (size_t)i, field);
+        fb_ref(&b, fpos[0], fb_string(&b, ARROW_COLUMNS[i].name));
+        fb_set(&b, fpos[2], ARROW_COLUMNS[i].type, 1);
+        fb_ref(&b, fpos[3], fb_type(&b, ARROW_COLUMNS[i].type));
+        fb_ref(&b, fpos[5], fb_vector(&b, 0, 4, 4)); // readers require children, even when empty
+    }
+    return arrow_encapsulate(out, &b);
+}
+
+static size_t pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// One record batch message (metadata + columnar body) for n rows. Returns its size, or 0 if
+// it does not fit in cap.
+static size_t arrow_batch(unsigned char* out, size_t cap, const HistorySample* rows, size_t n) {
+    size_t idbytes = 0;
+    for (size_t i = 0; i < n; i++) idbytes += strnlen(rows[i].sensor_id, 31);
+
+    // Body layout: every column gets an empty validity buffer (no nulls) and its data buffers
+    const size_t data_len[ARROW_NBUFFERS] = {
+        0, n * 8,                        // ts_ms
+        0, (n + 1) * 4, idbytes,         // sensor_id: offsets, bytes
+        0, n * 4, 0, n * 4, 0, n * 4, 0, n * 4,
+        0, n * 4,                        // alerts_mask
+        0, (n + 7) / 8,                  // flowing bitmap
+    };
+    uint64_t off[ARROW_NBUFFERS];
+    uint64_t body = 0;
+    for (int k = 0; k < ARROW_NBUFFERS; k++) {
+        off[k] = body;
+        body += pad8(data_len[k]);
+    }
+
+    if (cap < 8) return 0;
+    Fb b = { out + 8, 0, cap - 8, 0 };
+    size_t header = fb_message(&b, ARROW_HEADER_RECORD_BATCH, body);
+    static const unsigned char rb_sizes[3] = { 8, 4, 4 }; // length, nodes, buffers
+    size_t rpos[3];
+    size_t rb = fb_table(&b, 3, rb_sizes, rpos);
+    fb_ref(&b, header, rb);
+    fb_set(&b, rpos[0], n, 8);
+    size_t nodes = fb_vector(&b, ARROW_NCOLUMNS, 16, 8); // FieldNode { length, null_count }
+    fb_ref(&b, rpos[1], nodes);
+    for (int i = 0; i < ARROW_NCOLUMNS; i++) fb_set(&b, nodes + 4 + 16 * (size_t)i, n, 8);
+    size_t bufs = fb_vector(&b, ARROW_NBUFFERS, 16, 8);  // Buffer { offset, length }
+    fb_ref(&b, rpos[2], bufs);
+    for (int k = 0; k < ARROW_NBUFFERS; k++) {
+        fb_set(&b, bufs + 4 + 16 * (size_t)k, off[k], 8);
+        fb_set(&b, bufs + 12 + 16 * (size_t)k, data_len[k], 8);
+    }
+    size_t meta = arrow_encapsulate(out, &b);
+    if (meta == 0 || meta + body > cap) return 0;
+
+    unsigned char* base = out + meta;
+    unsigned char* ts = base + off[1];
+    unsigned char* offsets = base + off[3]; // payload starts at buf + CHUNK_HDR: no alignment, so memcpy
+    unsigned char* ids = base + off[4];
+    unsigned char* flow = base + off[6];
+    unsigned char* hum = base + off[8];
+    unsigned char* temp = base + off[10];
+    unsigned char* pres = base + off[12];
+    unsigned char* mask = base + off[14];
+    unsigned char* bits = base + off[16];
+    memset(bits, 0, pad8(data_len[16]));
+
+    int32_t pos = 0;
+    for (size_t i = 0; i < n; i++) {
+        const HistorySample* r = &rows[i];
+        int64_t t = (int64_t)r->ts_ms;
+        memcpy(ts + 8 * i, &t, 8);
+        size_t l = strnlen(r->sensor_id, 31);
+        memcpy(offsets + 4 * i, &pos, 4);
+        memcpy(ids + pos, r->sensor_id, l);
+        pos += (int32_t)l;
+        memcpy(flow + 4 * i, &r->flow_lpm, 4);
+        memcpy(hum + 4 * i, &r->humidity_pct, 4);
+        memcpy(temp + 4 * i, &r->temperature_c, 4);
+        memcpy(pres + 4 * i, &r->pressure_kpa, 4);
+        memcpy(mask + 4 * i, &r->alerts_mask, 4);
+        if (r->flowing) bits[i >> 3] |= (unsigned char)(1u << (i & 7));
+    }
+    memcpy(offsets + 4 * n, &pos, 4);
+    // Zero the alignment padding so output is deterministic
+    for (int k = 1; k < ARROW_NBUFFERS - 1; k++) {
+        memset(base + off[k] + data_len[k], 0, pad8(data_len[k]) - data_len[k]);
+    }
+    return meta + body;
+}
+
+// ---------- request handling ----------
+
+static int parse_ms(const char* v, uint64_t* out) {
+    if (!*v) return 0; // "from=" means no bound
+    char* end;
+    errno = 0;
+    unsigned long long x = strtoull(v, &end, 10);
+    if (*end || errno || v[0] == '-') return -1;
+    *out = x;
+    return 0;
+}
+
+int export_parse_query(const char* query, ExportQuery* out) {
+    out->from_ms = 0;
+    out->to_ms = UINT64_MAX;
+    out->format = EXPORT_CSV;
+    if (!query) return 0;
+
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", query);
+    char* save = NULL;
+    for (char* kv = strtok_r(buf, "&", &save); kv; kv = strtok_r(NULL, "&", &save)) {
+        char* v = strchr(kv, '=');
+        if (!v) continue;
+        *v++ = 0;
+        if (strcmp(kv, "from") == 0) {
+            if (parse_ms(v, &out->from_ms) != 0) return -1;
+        } else if (strcmp(kv, "to") == 0) {
+            if (parse_ms(v, &out->to_ms) != 0) return -1;
+        } else if (strcmp(kv, "format") == 0) {
+            if (strcmp(v, "csv") == 0) out->format = EXPORT_CSV;
+            else if (strcmp(v, "ndjson") == 0) out->format = EXPORT_NDJSON;
+            else if (strcmp(v, "arrow") == 0) out->format = EXPORT_ARROW;
+            else return -1;
+        }
+    }
+    return out->from_ms <= out->to_ms ? 0 : -1;
+}
+
+int export_http(History* h, const ExportQuery* q, int fd, const atomic_int* stop, ExportResult* res) {
+    static const char* ctypes[] = { "text/csv", "application/x-ndjson", "application/vnd.apache.arrow.stream" };
+    static const char* exts[] = { "csv", "ndjson", "arrows" };
+    ExportResult local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+
+    HistorySample* win = malloc(sizeof(HistorySample) * EXPORT_WINDOW);
+    char* buf = malloc(CHUNK_HDR + EXPORT_CHUNK_MAX + CHUNK_TAIL);
+    if (!win || !buf) {
+        free(win);
+        free(buf);
+        return -1;
+    }
+
+    char hdr[384];
+    int hl = snprintf(hdr, sizeof(hdr),
+        "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Disposition: attachment; filename=\"aquaguard-export.%s\"\r\n"
+        "Transfer-Encoding: chunked\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n",
+        ctypes[q->format], exts[q->format]);
+    ChunkOut c = { fd, buf, 0, res, write_all(fd, hdr, (size_t)hl) != 0 };
+
+    char* payload = chunk_payload(&c);
+    if (q->format == EXPORT_CSV) {
+        memcpy(payload, CSV_HEADER, sizeof(CSV_HEADER) - 1);
+        c.len = sizeof(CSV_HEADER) - 1;
+    } else if (q->format == EXPORT_ARROW) {
+        c.len = arrow_schema((unsigned char*)payload, EXPORT_CHUNK_MAX);
+    }
+
+    // Records appended after this point are not part of the export
+    uint64_t end;
+    uint64_t idx = history_seek(h, q->from_ms, &end);
+    int past_range = 0;
+    int complete = 1;                // every record in range went out
+    while (idx < end && !past_range && !c.failed) {
+        if (stop && atomic_load(stop)) { complete = 0; break; }
+        uint64_t want = end - idx < EXPORT_WINDOW ? end - idx : EXPORT_WINDOW;
+        uint64_t next;
+        size_t got = history_copy(h, idx, win, (size_t)want, &next);
+        // history_copy starts later than asked when ingest overwrote records while a slow client
+        // was reading: the export would have a hole, so it is cut short instead
+        if (got == 0 || next - got != idx) { complete = 0; break; }
+        idx = next;
+
+        size_t m = 0;
+        for (size_t i = 0; i < got; i++) {
+            if (win[i].ts_ms >= q->to_ms) { past_range = 1; break; }
+            if (win[i].ts_ms >= q->from_ms) win[m++] = win[i];
+        }
+        if (m == 0) continue;
+
+        if (q->format == EXPORT_ARROW) {
+            size_t n = arrow_batch((unsigned char*)payload + c.len, EXPORT_CHUNK_MAX - c.len, win, m);
+            if (n == 0) { chunk_emit(&c, 0); n = arrow_batch((unsigned char*)payload, EXPORT_CHUNK_MAX, win, m); }
+            if (n == 0) { complete = 0; break; }
+            c.len += n;
+            res->rows += m;
+            chunk_emit(&c, 0); // one chunk per record batch
+            continue;
+        }
+        for (size_t i = 0; i < m; i++) {
+            if (EXPORT_CHUNK_MAX - c.len < EXPORT_ROW_MAX) chunk_emit(&c, 0);
+            c.len += q->format == EXPORT_CSV ? format_csv(&win[i], payload + c.len) : format_ndjson(&win[i], payload + c.len);
+        }
+        res->rows += m;
+    }
+
+    // A cut-short export ends without the terminating chunk (and without the Arrow end-of-stream
+    // marker), so the client sees a truncated transfer instead of a complete-looking file.
+    if (!complete || c.failed) {
+        free(win);
+        free(buf);
+        return -1;
+    }
+    if (q->format == EXPORT_ARROW) {
+        static const unsigned char eos[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0 };
+        memcpy(payload + c.len, eos, sizeof(eos));
+        c.len += sizeof(eos);
+    }
+    chunk_emit(&c, 1);
+
+    int failed = c.failed;                 // the last write can still fail
+    free(win);
+    free(buf);
+    return failed ? -1 : 0;
+}
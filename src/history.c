@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "history.h"
+
+// Ring buffer of recent samples shared by every ingest path.
+// Readers copy out small windows under the lock, so they never hold it for long.
+
+int history_init(History* h, size_t capacity) {
+    memset(h, 0, sizeof(*h));
+    if (capacity == 0) capacity = 1;
+    h->ring = calloc(capacity, sizeof(HistorySample));
+    if (!h->ring) return -1;
+    h->capacity = capacity;
+    pthread_mutex_init(&h->mu, NULL);
+    return 0;
+}
+
+void history_free(History* h) {
+    free(h->ring);
+    h->ring = NULL;
+    h->capacity = 0;
+}
+
+uint64_t history_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+uint64_t history_append_batch(History* h, const SensorData* samples, int count) {
+    pthread_mutex_lock(&h->mu);
+    uint64_t ts_ms = history_now_ms();
+    if (ts_ms < h->last_ts) ts_ms = h->last_ts;
+    h->last_ts = ts_ms;
+    for (int i = 0; i < count; i++) {
+        const SensorData* s = &samples[i];
+        HistorySample* r = &h->ring[h->total % h->capacity];
+        r->ts_ms = ts_ms;
+        memcpy(r->sensor_id, s->sensor_id, sizeof(r->sensor_id));
+        r->flow_lpm = s->flow_lpm;
+        r->humidity_pct = s->humidity_pct;
+        r->temperature_c = s->temperature_c;
+        r->pressure_kpa = s->pressure_kpa;
+        r->alerts_mask = (uint32_t)s->alerts_mask;
+        r->flowing = s->flowing ? 1u : 0u;
+        h->total++;
+    }
+    pthread_mutex_unlock(&h->mu);
+    return ts_ms;
+}
+
+void history_append_records(History* h, const HistorySample* recs, size_t count) {
+    pthread_mutex_lock(&h->mu);
+    for (size_t i = 0; i < count; i++) {
+        h->ring[h->total % h->capacity] = recs[i];
+        h->total++;
+        if (recs[i].ts_ms > h->last_ts) h->last_ts = recs[i].ts_ms;
+    }
+    pthread_mutex_unlock(&h->mu);
+}
+
+size_t history_copy(History* h, uint64_t from, HistorySample* out, size_t max, uint64_t* next) {
+    pthread_mutex_lock(&h->mu);
+    uint64_t oldest = h->total > h->capacity ? h->total - h->capacity : 0;
+    if (from < oldest) from = oldest; // those were already overwritten
+    size_t n = 0;
+    while (from + n < h->total && n < max) {
+        out[n] = h->ring[(from + n) % h->capacity];
+        n++;
+    }
+    pthread_mutex_unlock(&h->mu);
+    if (next) *next = from + n;
+    return n;
+}
+
+uint64_t history_seek(History* h, uint64_t ts_ms, uint64_t* end) {
+    pthread_mutex_lock(&h->mu);
+    uint64_t lo = h->total > h->capacity ? h->total - h->capacity : 0;
+    uint64_t hi = h->total;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (h->ring[mid % h->capacity].ts_ms < ts_ms) lo = mid + 1;
+        else hi = mid;
+    }
+    if (end) *end = h->total;
+    pthread_mutex_unlock(&h->mu);
+    return lo;
+}
@@ -10,8 +10,18 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <poll.h>
 
 #include "http.h"
+#include "pipeline.h"
+#include "ingest.h"
+#include "devices.h"
+#include "state.h"
+#include "serialize.h"
+#include "subs.h"
+#include "uplink.h"
+#include "notify.h"
+#include "export.h"
 #include "log.h"
 
 // This file is a tiny web server for the dashboard.
@@ -25,6 +35,11 @@ static const char* WEB_ROOT = "web";
 
 // Tiny helpers for serving static files (HTML/JS/CSS/images) from the web folder
 // Rolling our own here avoids pulling in a full HTTP library for a handful of routes.
+static void send_400(int fd, const char* why) {
+    dprintf(fd, "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s",
+            strlen(why), why);
+}
+
 static void send_404(int fd) {
     const char* msg = "HTTP/1.1 404 Not Found\r\n"
                       "Content-Type: text/plain\r\n"
@@ -64,75 +79,125 @@ static const char* guess_ctype(const char* p) {
     return "text/plain";
 }
 
-// Safer strcat for fixed buffers
-static void cat_safe(char* dst, size_t dstsz, const char* src) {
-    size_t len = strlen(dst);
-    if (len >= dstsz - 1) return;
-    strncat(dst, src, dstsz - len - 1);
+static void send_json(int fd, const char* body, size_t len) {
+    char hdr[160];
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n",
+                        len);
+    write(fd, hdr, hlen);
+    write(fd, body, len);
 }
 
-// Fill both JSON alert list and human summary
-static void build_alerts(AlertFlags mask, char* list_out, size_t list_sz, char* summary_out, size_t sum_sz) {
-    int first = 1;
-    list_out[0] = '['; list_out[1] = 0;
-    summary_out[0] = 0;
-
-#define ADD(alert_flag, code, label) \
-    if (mask & alert_flag) { \
-        if (!first) { cat_safe(list_out, list_sz, ","); cat_safe(summary_out, sum_sz, ", "); } \
-        cat_safe(list_out, list_sz, "\"" code "\""); \
-        cat_safe(summary_out, sum_sz, label); \
-        first = 0; \
-    }
-    ADD(ALERTF_HIGH_FLOW, "HIGH_FLOW", "High flow");
-    ADD(ALERTF_LOW_FLOW, "LOW_FLOW", "Low flow");
-    ADD(ALERTF_HIGH_HUMIDITY, "HIGH_HUMIDITY", "High humidity");
-    ADD(ALERTF_HIGH_TEMP, "HIGH_TEMP", "High temperature");
-    ADD(ALERTF_HIGH_PRESSURE, "HIGH_PRESSURE", "High pressure");
-#undef ADD
-
-    if (first) {
-        // No alerts at all
-        strncpy(list_out, "[]", list_sz);
-        list_out[list_sz - 1] = 0;
-        strncpy(summary_out, "None", sum_sz);
-        summary_out[sum_sz - 1] = 0;
-        return;
-    }
-    cat_safe(list_out, list_sz, "]");
+// Snapshot ingest statistics as a small JSON document
+static void send_stats(int fd, SharedState* st, SubHub* hub) {
+    static const char* mode_names[] = { "sim", "tcp", "listen" };
+    char pipe[512] = "null";
+    char shards[MAX_SHARDS * 128] = "[]";
+    pthread_mutex_lock(&st->mu);
+    if (st->pipeline) pipeline_stats_json(st->pipeline, pipe, sizeof(pipe));
+    uint64_t seq = st->data.last_seq;
+    pthread_mutex_unlock(&st->mu);
+    if (st->shards) ingest_stats_json(st, shards, sizeof(shards));
+    char subs[256] = "null";
+    if (hub) subs_stats_json(hub, subs, sizeof(subs));
+    char uplink[768] = "null";
+    if (st->uplink) uplink_stats_json(st->uplink, uplink, sizeof(uplink));
+    char alerts[512 + MAX_WEBHOOKS * 512] = "null";
+    if (st->notify) notify_stats_json(st->notify, alerts, sizeof(alerts));
+    size_t peers_cap = st->uplink_peers ? (size_t)UPLINK_MAX_PEERS * 256 : 8;
+    char* peers = malloc(peers_cap);
+    if (!peers) { send_404(fd); return; }
+    strcpy(peers, "null");
+    if (st->uplink_peers) uplink_peers_stats_json(st->uplink_peers, peers, peers_cap);
+
+    size_t cap = sizeof(shards) + sizeof(subs) + sizeof(uplink) + sizeof(alerts) + peers_cap + 768;
+    char* body = malloc(cap);
+    if (!body) { free(peers); send_404(fd); return; }
+    int len = snprintf(body, cap, "{ \"mode\": \"%s\", \"seq\": %llu, \"pipeline\": %s, \"shards\": %s, \"subscriptions\": %s, "
+                       "\"uplink\": %s, \"uplink_peers\": %s, \"alerts\": %s }",
+                       mode_names[st->mode], (unsigned long long)seq, pipe, shards, subs, uplink, peers, alerts);
+    send_json(fd, body, (size_t)len);
+    free(peers);
+    free(body);
 }
 
-// Convert SensorData into a single JSON string for SSE.
-// The browser receives this string and updates the dashboard in real time.
-static void json_for_current(SensorData* d, char* out, size_t outsz) {
-    const char* conn = d->conn == CONN_CONNECTED ? "CONNECTED" : "DISCONNECTED";
-    char alert_list[128];
-    char alert_summary[128];
-    build_alerts(d->alerts_mask, alert_list, sizeof(alert_list), alert_summary, sizeof(alert_summary));
-    snprintf(out, outsz,
-        "{ \"flow_lpm\": %.2f, \"humidity_pct\": %.2f, \"temperature_c\": %.2f, \"pressure_kpa\": %.2f, \"alerts\": %s, \"connection\": \"%s\", \"via\": \"%s\", \"seq\": %llu, \"alert_summary\": \"%s\" }",
-        d->flow_lpm, d->humidity_pct, d->temperature_c, d->pressure_kpa, alert_list, conn, d->via, (unsigned long long)d->last_seq, alert_summary);
+// Merged view of every device across all ingest slices
+static void send_devices(int fd, SharedState* st) {
+    SensorData* devs = malloc(sizeof(SensorData) * MAX_DEVICES * (size_t)st->nslices);
+    size_t cap = 256 + (size_t)MAX_DEVICES * (size_t)st->nslices * 512;
+    char* body = malloc(cap);
+    if (!devs || !body) { free(devs); free(body); send_404(fd); return; }
+
+    int n = state_merged_devices(st, devs, NULL, MAX_DEVICES * st->nslices);
+    size_t used = (size_t)snprintf(body, cap, "[");
+    for (int i = 0; i < n; i++) {
+        SensorData* d = &devs[i];
+        // Room for the closing bracket is kept back; a device that does not fit ends the list
+        int w = snprintf(body + used, cap - 1 - used,
+            "%s{ \"sensor_id\": \"%s\", \"flow_lpm\": %.2f, \"humidity_pct\": %.2f, \"temperature_c\": %.2f, "
+            "\"pressure_kpa\": %.2f, \"alerts_mask\": %d, \"seq\": %llu }",
+            i ? ", " : "", d->sensor_id, d->flow_lpm, d->humidity_pct, d->temperature_c, d->pressure_kpa,
+            (int)d->alerts_mask, (unsigned long long)d->last_seq);
+        if (w < 0 || (size_t)w >= cap - 1 - used) break;
+        used += (size_t)w;
+    }
+    body[used++] = ']';
+    send_json(fd, body, used);
+    free(devs);
+    free(body);
 }
 
 typedef struct {
     int fd;
     SharedState* st;
+    SubHub* hub;
+    int slot;
 } ClientCtx;
 
-// Handle a single HTTP client (either SSE stream or static file request)
-static void* handle_client(void* arg) {
-    ClientCtx* ctx = (ClientCtx*)arg;
-    int fd = ctx->fd;
-    SharedState* st = ctx->st;
-    free(ctx);
+// Client threads are detached but registered here, so shutdown can cut their sockets and wait
+// for them before SharedState (history, slices, uplink and alert state) is freed.
+#define HTTP_MAX_CLIENTS 1024
+static pthread_mutex_t clients_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_cv = PTHREAD_COND_INITIALIZER;
+static int client_fds[HTTP_MAX_CLIENTS];
+static int nclients;
 
+// Returns a slot, or -1 when too many clients are connected
+static int client_register(int fd) {
+    pthread_mutex_lock(&clients_mu);
+    int slot = -1;
+    if (nclients < HTTP_MAX_CLIENTS) {
+        for (slot = 0; client_fds[slot] >= 0; slot++) {}
+        client_fds[slot] = fd;
+        nclients++;
+    }
+    pthread_mutex_unlock(&clients_mu);
+    return slot;
+}
+
+// Shut down every client socket (blocked writes fail at once) and wait for the threads to go
+static void clients_drain(void) {
+    pthread_mutex_lock(&clients_mu);
+    for (int i = 0; i < HTTP_MAX_CLIENTS; i++) {
+        if (client_fds[i] >= 0) shutdown(client_fds[i], SHUT_RDWR);
+    }
+    while (nclients > 0) pthread_cond_wait(&clients_cv, &clients_mu);
+    pthread_mutex_unlock(&clients_mu);
+}
+
+// Handle a single HTTP client (either SSE stream or static file request).
+// Returns 1 if the connection was handed to the subscription hub, 0 if the caller closes it.
+static int serve_client(int fd, SharedState* st, SubHub* hub) {
     char req[1024];
     int n = read(fd, req, sizeof(req) - 1);
-    if (n <= 0) { close(fd); return NULL; }
+    if (n <= 0) return 0;
     req[n] = 0;
 
     char method[8], path[512];
-    if (sscanf(req, "%7s %511s", method, path) != 2) { close(fd); return NULL; }
+    if (sscanf(req, "%7s %511s", method, path) != 2) return 0;
+    // Split off the query string (/events and /export use it; static files ignore it)
+    char* query = strchr(path, '?');
+    if (query) *query++ = 0;
     if (strcmp(path, "/") == 0) strcpy(path, "/index.html");
 
     // Live updates via Server-Sent Events:
@@ -143,26 +208,73 @@ static void* handle_client(void* arg) {
                           "Content-Type: text/event-stream\r\n"
                           "Cache-Control: no-cache\r\n"
                           "Connection: keep-alive\r\n\r\n";
+
+        // Filtered streams (?sensors=..&fields=..&alerts_only=1) are handed to the subscription
+        // hub, which serializes each update once per distinct filter; this thread is done then.
+        SubFilter filter;
+        int filtered = subs_parse_filter(query, &filter);
+        if (filtered < 0) {
+            send_400(fd, "bad filter: unknown field or too many sensors");
+            return 0;
+        }
+        if (filtered) {
+            write(fd, hdr, strlen(hdr));
+            return hub && subs_add(hub, fd, &filter) == 0;
+        }
+
         write(fd, hdr, strlen(hdr));
 
         uint64_t last_seq = 0;
-        for (;;) {
+        while (!state_stopping(st)) {
             pthread_mutex_lock(&st->mu);
             uint64_t seq = st->data.last_seq;
             SensorData snap = st->data;
             pthread_mutex_unlock(&st->mu);
 
+            // The frame is serialized straight into one buffer and sent with a single write()
+            ssize_t rc;
             if (seq != last_seq) {
-                char json[384];
-                json_for_current(&snap, json, sizeof(json));
-                dprintf(fd, "data: %s\n\n", json);
+                char frame[SSE_FRAME_MAX + 8];
+                size_t len = sse_format_frame(&snap, frame, sizeof(frame));
+                rc = write(fd, frame, len);
                 last_seq = seq;
             } else {
-                dprintf(fd, ": keepalive\n\n");
+                static const char keepalive[] = ": keepalive\n\n";
+                rc = write(fd, keepalive, sizeof(keepalive) - 1);
             }
-            // If client disconnects, writes will eventually fail
+            // If client disconnects, writes will eventually fail and the thread can go
+            if (rc < 0) break;
             usleep(2000 * 1000);
         }
+        return 0;
+    }
+
+    // Runtime counters for operators (ingest queue depths, parse errors).
+    // Plain JSON with Content-Length so curl/scripts can read it without SSE handling.
+    if (strcmp(path, "/stats") == 0) {
+        send_stats(fd, st, hub);
+        return 0;
+    }
+    if (strcmp(path, "/devices") == 0) {
+        send_devices(fd, st);
+        return 0;
+    }
+
+    // Bulk download of the history store, streamed in chunks (see export.h)
+    if (strcmp(path, "/export") == 0) {
+        ExportQuery q;
+        if (!st->history) {
+            send_400(fd, "history is disabled");
+        } else if (export_parse_query(query, &q) != 0) {
+            send_400(fd, "bad export query: from/to are ms timestamps, format is csv, ndjson or arrow");
+        } else {
+            ExportResult res;
+            if (export_http(st->history, &q, fd, &st->stop, &res) == 0) {
+                LOG_INFO("export: %llu rows, %llu bytes in %llu chunks", (unsigned long long)res.rows,
+                         (unsigned long long)res.bytes, (unsigned long long)res.chunks);
+            }
+        }
+        return 0;
     }
 
     // Otherwise serve a static file from web/ (HTML, CSS, JS, images) to render the dashboard
@@ -170,7 +282,23 @@ static void* handle_client(void* arg) {
     snprintf(full, sizeof(full), "%s%s", WEB_ROOT, path);
     send_file(fd, full, guess_ctype(full));
 
-    close(fd);
+    return 0;
+}
+
+// Leave the registry before closing, so clients_drain never sees a reused descriptor
+static void client_release(ClientCtx* ctx, int kept) {
+    pthread_mutex_lock(&clients_mu);
+    client_fds[ctx->slot] = -1;
+    nclients--;
+    pthread_cond_signal(&clients_cv);
+    pthread_mutex_unlock(&clients_mu);
+    if (!kept) close(ctx->fd);
+    free(ctx);
+}
+
+static void* handle_client(void* arg) {
+    ClientCtx* ctx = (ClientCtx*)arg;
+    client_release(ctx, serve_client(ctx->fd, ctx->st, ctx->hub));
     return NULL;
 }
 
@@ -199,17 +327,42 @@ void* http_server_thread(void* arg) {
         exit(1);
     }
     LOG_INFO("HTTP server listening on http://localhost:%d", port);
+    for (int i = 0; i < HTTP_MAX_CLIENTS; i++) client_fds[i] = -1;
 
-    for (;;) {
+    // Filtered /events subscribers are served by one hub thread instead of a thread each.
+    // main creates the hub before ingest starts (state_publish_batch feeds it) and frees it.
+    SubHub* hub = st->subs;
+    pthread_t th_hub;
+    if (hub && pthread_create(&th_hub, NULL, subs_thread, hub) != 0) hub = NULL;
+
+    while (!state_stopping(st)) {
+        // Poll with a timeout so the thread notices shutdown instead of blocking in accept()
+        struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
         int cfd = accept(fd, NULL, NULL);
         if (cfd < 0) continue;
 
         pthread_t th;
         ClientCtx* ctx = malloc(sizeof(ClientCtx));
+        int slot = ctx ? client_register(cfd) : -1;
+        if (slot < 0) {
+            free(ctx);
+            close(cfd);
+            continue;
+        }
         ctx->fd = cfd;
         ctx->st = st;
-        pthread_create(&th, NULL, handle_client, ctx);
+        ctx->hub = hub;
+        ctx->slot = slot;
+        if (pthread_create(&th, NULL, handle_client, ctx) != 0) {
+            client_release(ctx, 0);
+            continue;
+        }
         pthread_detach(th);
     }
+    close(fd);
+    clients_drain();
+    // The hub thread is done once it sees the stop flag; main frees the hub after ingest stops
+    if (hub) pthread_join(th_hub, NULL);
     return NULL;
 }
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ingest.h"
+#include "json.h"
+#include "state.h"
+#include "log.h"
+
+// Sharded ingest server for --mode listen.
+// One poll() loop per shard keeps things thread-per-shard (like the rest of the gateway uses
+// thread-per-job) while still serving many device connections per thread.
+
+// Open one SO_REUSEPORT listener. Non-blocking so a connection stolen by another shard
+// between poll() and accept() does not stall this one.
+static int open_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        LOG_WARN("SO_REUSEPORT unavailable: %s", strerror(errno));
+    }
+#endif
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+static int total_active(SharedState* st) {
+    int n = 0;
+    for (int i = 0; i < st->nshards; i++) n += atomic_load(&st->shards[i].active);
+    return n;
+}
+
+// Hand the shard's pending samples to its device slice and the dashboard in one go
+static void shard_publish(IngestShard* sh) {
+    if (sh->nbatch == 0) return;
+    state_publish_batch(sh->st, sh->batch, sh->nbatch);
+    sh->nbatch = 0;
+}
+
+static void shard_accept(IngestShard* sh) {
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        int cfd = accept(sh->listen_fd, (struct sockaddr*)&peer, &plen);
+        if (cfd < 0) return; // EAGAIN: drained (or another shard took it)
+
+        if (sh->nconns == sh->cap_conns) {
+            int cap = sh->cap_conns ? sh->cap_conns * 2 : 16;
+            ShardConn* grown = realloc(sh->conns, (size_t)cap * sizeof(ShardConn));
+            if (!grown) { close(cfd); return; }
+            sh->conns = grown;
+            sh->cap_conns = cap;
+        }
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL, 0) | O_NONBLOCK);
+
+        ShardConn* c = &sh->conns[sh->nconns++];
+        memset(c, 0, sizeof(*c));
+        c->fd = cfd;
+        // Devices that never send sensor_id are told apart by their IP (not the port, which
+        // changes on every reconnect and would add a new entry each time). Devices behind one
+        // address share that entry; it counts their connections and stays connected until the
+        // last one closes.
+        inet_ntop(AF_INET, &peer.sin_addr, c->cur.sensor_id, sizeof(c->cur.sensor_id));
+
+        atomic_fetch_add(&sh->active, 1);
+        atomic_fetch_add_explicit(&sh->accepted, 1, memory_order_relaxed);
+    }
+}
+
+static void shard_line(IngestShard* sh, ShardConn* c) {
+    c->line[c->len] = 0;
+    c->len = 0;
+    atomic_fetch_add_explicit(&sh->lines, 1, memory_order_relaxed);
+
+    SensorData tmp = c->cur;
+    if (parse_sensor_json(c->line, &tmp) != 0) {
+        atomic_fetch_add_explicit(&sh->parse_errors, 1, memory_order_relaxed);
+        return;
+    }
+    tmp.conn = CONN_CONNECTED;
+    snprintf(tmp.via, sizeof(tmp.via), "LISTEN");
+    if (strcmp(tmp.sensor_id, c->counted) != 0) {
+        // Counted before its sample is published, so a close racing on another shard sees it
+        if (c->counted[0]) state_device_conn_release(sh->st, c->counted, 0);
+        state_device_conn_open(sh->st, tmp.sensor_id);
+        memcpy(c->counted, tmp.sensor_id, sizeof(c->counted));
+    }
+    c->cur = tmp;
+    sh->batch[sh->nbatch++] = tmp;
+    if (sh->nbatch == PIPE_BATCH_MAX) shard_publish(sh);
+}
+
+// Returns -1 once the device hung up
+static int shard_read(IngestShard* sh, ShardConn* c) {
+    ssize_t n = read(c->fd, sh->rbuf, sizeof(sh->rbuf));
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    // JSON devices start with '{' (or whitespace); gateway uplinks with their "AQ.." magic
+    if (!c->sniffed) {
+        c->sniffed = 1;
+        if (sh->rbuf[0] == UPLINK_MAGIC_HELLO[0] && sh->st->uplink_peers) {
+            c->up = calloc(1, sizeof(UplinkRx));
+            if (!c->up) return -1;
+            c->up->peer = -1;
+        }
+    }
+    if (c->up) return uplink_rx_feed(sh->st, sh->id, c->up, c->fd, sh->rbuf, (size_t)n);
+
+    for (ssize_t i = 0; i < n; i++) {
+        char ch = sh->rbuf[i];
+        if (ch == '\n' || c->len >= PIPE_MAX_LINE - 1) shard_line(sh, c);
+        else c->line[c->len++] = ch;
+    }
+    return 0;
+}
+
+static void shard_close(IngestShard* sh, int idx) {
+    close(sh->conns[idx].fd);
+    if (sh->conns[idx].up) {
+        uplink_rx_close(sh->st, sh->conns[idx].up);
+        free(sh->conns[idx].up);
+    } else {
+        // Otherwise its entry would keep claiming a connection that is gone
+        state_device_conn_release(sh->st, sh->conns[idx].counted, 1);
+    }
+    sh->conns[idx] = sh->conns[--sh->nconns];
+    atomic_fetch_sub(&sh->active, 1);
+    if (total_active(sh->st) == 0) state_set_connection(sh->st, CONN_DISCONNECTED, "LISTEN");
+}
+
+static void* shard_main(void* arg) {
+    IngestShard* sh = (IngestShard*)arg;
+    struct pollfd* pfds = NULL;
+    int cap_pfds = 0;
+
+    while (!atomic_load(&sh->stop)) {
+        int want = sh->nconns + 1;
+        if (want > cap_pfds) {
+            struct pollfd* grown = realloc(pfds, (size_t)want * 2 * sizeof(*pfds));
+            if (!grown) break;
+            pfds = grown;
+            cap_pfds = want * 2;
+        }
+        pfds[0].fd = sh->listen_fd;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < sh->nconns; i++) {
+            pfds[i + 1].fd = sh->conns[i].fd;
+            // An uplink whose ack did not fit the socket waits for room without holding up the shard
+            ShardConn* c = &sh->conns[i];
+            pfds[i + 1].events = POLLIN | (c->up && uplink_rx_want_write(c->up) ? POLLOUT : 0);
+        }
+
+        // Short timeout so a stop request is noticed promptly
+        int rc = poll(pfds, (nfds_t)want, 200);
+        if (rc <= 0) continue;
+
+        // Walk connections backwards so closing one (swap-with-last) keeps indices valid
+        for (int i = want - 1; i >= 1; i--) {
+            if (!pfds[i].revents) continue;
+            ShardConn* c = &sh->conns[i - 1];
+            int gone = (pfds[i].revents & POLLOUT) && c->up && uplink_rx_flush(c->up, c->fd) != 0;
+            if (!gone && (pfds[i].revents & ~POLLOUT)) gone = shard_read(sh, c) != 0;
+            if (gone) {
+                shard_publish(sh); // samples from this device land before it is forgotten
+                shard_close(sh, i - 1);
+            }
+        }
+        shard_publish(sh);
+        if (pfds[0].revents & POLLIN) shard_accept(sh);
+    }
+
+    shard_publish(sh);
+    while (sh->nconns > 0) shard_close(sh, sh->nconns - 1);
+    free(pfds);
+    return NULL;
+}
+
+int ingest_start(SharedState* st) {
+    if (st->nshards < 1) st->nshards = 1;
+    if (st->nshards > MAX_SHARDS) st->nshards = MAX_SHARDS;
+    if (st->nslices < st->nshards) {
+        LOG_ERR("ingest needs one device slice per shard (%d < %d)", st->nslices, st->nshards);
+        return -1;
+    }
+
+    IngestShard* shards = calloc((size_t)st->nshards, sizeof(IngestShard));
+    if (!shards) return -1;
+
+    for (int i = 0; i < st->nshards; i++) {
+        int fd = open_listener(st->ingest_port);
+        if (fd < 0) {
+            LOG_ERR("ingest listener %d on port %d failed: %s", i, st->ingest_port, strerror(errno));
+            for (int k = 0; k < i; k++) close(shards[k].listen_fd);
+            free(shards);
+            return -1;
+        }
+        if (st->ingest_port == 0) {
+            // Port 0 asked for any free port; every other shard must join that same port
+            struct sockaddr_in addr;
+            socklen_t alen = sizeof(addr);
+            getsockname(fd, (struct sockaddr*)&addr, &alen);
+            st->ingest_port = ntohs(addr.sin_port);
+        }
+        shards[i].id = i;
+        shards[i].listen_fd = fd;
+        shards[i].st = st;
+    }
+
+    st->shards = shards;
+    int started = 0;
+    while (started < st->nshards && pthread_create(&shards[started].th, NULL, shard_main, &shards[started]) == 0) {
+        started++;
+    }
+    if (started < st->nshards) {
+        // Half an ingest would silently drop the connections the kernel hands to dead listeners
+        LOG_ERR("ingest shard %d thread failed to start", started);
+        for (int i = 0; i < started; i++) atomic_store(&shards[i].stop, 1);
+        for (int i = 0; i < st->nshards; i++) {
+            if (i < started) pthread_join(shards[i].th, NULL);
+            close(shards[i].listen_fd);
+            free(shards[i].conns);
+        }
+        free(shards);
+        st->shards = NULL;
+        return -1;
+    }
+    LOG_INFO("Ingest listening on :%d with %d shard%s", st->ingest_port, st->nshards, st->nshards == 1 ? "" : "s");
+    return 0;
+}
+
+void ingest_stop(SharedState* st) {
+    if (!st->shards) return;
+    for (int i = 0; i < st->nshards; i++) atomic_store(&st->shards[i].stop, 1);
+    for (int i = 0; i < st->nshards; i++) {
+        pthread_join(st->shards[i].th, NULL);
+        close(st->shards[i].listen_fd);
+        free(st->shards[i].conns);
+    }
+    free(st->shards);
+    st->shards = NULL;
+}
+
+int ingest_stats_json(SharedState* st, char* out, size_t outsz) {
+    size_t used = 0;
+    int n = snprintf(out, outsz, "[");
+    if (n < 0 || (size_t)n >= outsz) return -1;
+    used = (size_t)n;
+    for (int i = 0; st->shards && i < st->nshards; i++) {
+        IngestShard* sh = &st->shards[i];
+        n = snprintf(out + used, outsz - used,
+            "%s{ \"shard\": %d, \"active\": %d, \"accepted\": %llu, \"lines\": %llu, \"parse_errors\": %llu }",
+            i ? ", " : "", i, atomic_load(&sh->active),
+            (unsigned long long)atomic_load(&sh->accepted),
+            (unsigned long long)atomic_load(&sh->lines),
+            (unsigned long long)atomic_load(&sh->parse_errors));
+        if (n < 0 || (size_t)n >= outsz - used) return -1;
+        used += (size_t)n;
+    }
+    n = snprintf(out + used, outsz - used, "]");
+    if (n < 0 || (size_t)n >= outsz - used) return -1;
+    return (int)(used + (size_t)n);
+}
@@ -51,6 +51,30 @@ static int extract_bool(const char* s, const char* key, int* out) {
     return -1;
 }
 
+// Copy a short string value (up to the closing quote) for a known key; used for the optional sensor id.
+// Returns -1 if the key is missing or empty, -2 if the value does not fit out (never truncated:
+// two long ids sharing a prefix would otherwise become the same device).
+static int extract_string(const char* s, const char* key, char* out, size_t outsz) {
+    const char* start = find_value_start(s, key);
+    if (!start) return -1;
+    size_t n = 0;
+    while (start[n] && start[n] != '"') {
+        if (++n > outsz - 1) return -2;
+    }
+    if (n == 0) return -1;
+    memcpy(out, start, n);
+    out[n] = 0;
+    return 0;
+}
+
+int sensor_id_valid(const char* id) {
+    if (!id[0]) return 0;
+    for (const unsigned char* p = (const unsigned char*)id; *p; p++) {
+        if (*p < 0x20 || *p > 0x7E || *p == '"' || *p == '\\') return 0;
+    }
+    return 1;
+}
+
 int parse_sensor_json(const char* line, SensorData* out) {
     if (!line || !out) return -1;
 
@@ -72,6 +96,11 @@ int parse_sensor_json(const char* line, SensorData* out) {
     if (extract_float(line, "pressure_kpa", &pressure) == 0) has_pressure = 1;
     if (extract_bool(line, "flowing", &flowing) == 0) has_flowing = 1;
 
+    char id[sizeof(out->sensor_id)];
+    int id_rc = extract_string(line, "sensor_id", id, sizeof(id));
+    int has_id = id_rc == 0;
+    if (id_rc == -2 || (has_id && !sensor_id_valid(id))) return -1;
+
     // Copy values into output so the rest of the program can read them
     out->flow_lpm = flow;
     out->humidity_pct = hum;
@@ -79,6 +108,8 @@ int parse_sensor_json(const char* line, SensorData* out) {
     if (has_pressure) out->pressure_kpa = pressure;
     if (has_flowing) out->flowing = flowing ? true : false;
     else out->flowing = true;
+    // Devices that share one gateway identify themselves; otherwise the previous id is kept
+    if (has_id) memcpy(out->sensor_id, id, sizeof(id));
 
     // Build alert mask in one pass.
     // The HTTP thread uses these flags to display warning banners on the dashboard.
@@ -12,11 +12,19 @@
 #include "shared.h"
 #include "sensor.h"
 #include "http.h"
+#include "ingest.h"
+#include "state.h"
+#include "json.h"
+#include "history.h"
+#include "snapshot.h"
+#include "uplink.h"
+#include "notify.h"
+#include "subs.h"
 #include "log.h"
 
 static volatile int running = 1;
 
-// Stop the program when Ctrl+C is pressed (friendly shutdown)
+// Stop the program when Ctrl+C (or a service manager's SIGTERM) arrives (friendly shutdown)
 static void on_sigint(int s) {
     (void)s;
     running = 0;
@@ -31,7 +39,14 @@ static void ignore_sigpipe(void) {
 
 // Print a tiny help line so users know the knobs they can turn
 static void print_usage(const char* prog) {
-    printf("Usage: %s [--mode tcp|sim] [--tcp-host HOST] [--tcp-port P] [--web-port P]\n", prog);
+    printf("Usage: %s [--mode tcp|sim|listen] [--tcp-host HOST] [--tcp-port P] [--web-port P]\n"
+           "       [--pin-cores R,P,U]   pin TCP reader/parser/publisher stages to cores\n"
+           "       [--ingest-port P] [--shards N]   listen mode: devices connect here, N SO_REUSEPORT shards\n"
+           "       [--snapshot PATH | --no-snapshot] [--history N]   warm-start file and samples kept\n"
+           "       [--uplink HOST:PORT] [--uplink-id NAME]   forward every sample to an aggregator (listen mode);\n"
+           "                            NAME (default: host name) also tags alert webhook payloads\n"
+           "       [--uplink-spill PATH | --no-uplink-spill] [--uplink-spill-mb N]   buffer while it is down\n"
+           "       [--webhook URL]...  [--dead-letter PATH]   POST alert raise/clear events (up to %d URLs)\n", prog, MAX_WEBHOOKS);
 }
 
 // Put all the startup defaults in one spot for the shared state that EVERY thread uses:
@@ -41,22 +56,37 @@ static void print_usage(const char* prog) {
 static void init_defaults(SharedState* st) {
     memset(st, 0, sizeof(*st));
     pthread_mutex_init(&st->mu, NULL);
-    st->mode_tcp = 1; // default to TCP streaming
+    st->mode = MODE_TCP; // default to TCP streaming
     strcpy(st->tcp_host, "127.0.0.1");
     st->tcp_port = 5555;
     st->web_port = 8080;
+    st->ingest_port = 6000;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    st->nshards = ncpu > 0 ? (int)ncpu : 1; // one shard per core unless told otherwise
+    for (int i = 0; i < 3; i++) st->pin_cores[i] = -1;
     st->data.conn = CONN_DISCONNECTED;
     snprintf(st->data.via, sizeof(st->data.via), "TCP");
+    snprintf(st->data.sensor_id, sizeof(st->data.sensor_id), "default");
+    snprintf(st->snapshot_path, sizeof(st->snapshot_path), "aquaguard.snap");
+    // Gateways are told apart upstream by host name unless --uplink-id says otherwise
+    if (gethostname(st->uplink_id, sizeof(st->uplink_id) - 1) != 0 || !st->uplink_id[0]) {
+        snprintf(st->uplink_id, sizeof(st->uplink_id), "gateway");
+    }
+    snprintf(st->spill_path, sizeof(st->spill_path), "aquaguard.spill");
+    st->spill_max = UPLINK_SPILL_DEFAULT;
+    snprintf(st->dead_letter_path, sizeof(st->dead_letter_path), "aquaguard-alerts.dead");
+    atomic_init(&st->stop, 0);
 }
 
 // Very direct argument parser (kept student-simple):
 // picks between TCP vs simulator and overrides ports/host if provided.
 // SharedState carries these choices so both threads see the same config.
-static void parse_args(int argc, char** argv, SharedState* st) {
+static void parse_args(int argc, char** argv, SharedState* st, size_t* history_cap) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
-            if (strcmp(argv[i + 1], "tcp") == 0) st->mode_tcp = 1;
-            else if (strcmp(argv[i + 1], "sim") == 0) st->mode_tcp = 0;
+            if (strcmp(argv[i + 1], "tcp") == 0) st->mode = MODE_TCP;
+            else if (strcmp(argv[i + 1], "sim") == 0) st->mode = MODE_SIM;
+            else if (strcmp(argv[i + 1], "listen") == 0) st->mode = MODE_LISTEN;
             i++;
         } else if (strcmp(argv[i], "--tcp-host") == 0 && i + 1 < argc) {
             strncpy(st->tcp_host, argv[i + 1], sizeof(st->tcp_host) - 1);
@@ -67,6 +97,67 @@ static void parse_args(int argc, char** argv, SharedState* st) {
         } else if (strcmp(argv[i], "--web-port") == 0 && i + 1 < argc) {
             st->web_port = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "--ingest-port") == 0 && i + 1 < argc) {
+            st->ingest_port = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            st->nshards = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snprintf(st->snapshot_path, sizeof(st->snapshot_path), "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--no-snapshot") == 0) {
+            st->snapshot_path[0] = 0;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            long n = atol(argv[i + 1]);
+            if (n > 0) *history_cap = (size_t)n;
+            i++;
+        } else if (strcmp(argv[i], "--uplink") == 0 && i + 1 < argc) {
+            // "host:port" of the aggregator; a bare port means localhost
+            const char* colon = strrchr(argv[i + 1], ':');
+            if (colon) {
+                size_t hl = (size_t)(colon - argv[i + 1]);
+                if (hl >= sizeof(st->uplink_host)) hl = sizeof(st->uplink_host) - 1;
+                memcpy(st->uplink_host, argv[i + 1], hl);
+                st->uplink_host[hl] = 0;
+                st->uplink_port = atoi(colon + 1);
+            } else {
+                strcpy(st->uplink_host, "127.0.0.1");
+                st->uplink_port = atoi(argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--uplink-id") == 0 && i + 1 < argc) {
+            snprintf(st->uplink_id, sizeof(st->uplink_id), "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--uplink-spill") == 0 && i + 1 < argc) {
+            snprintf(st->spill_path, sizeof(st->spill_path), "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--no-uplink-spill") == 0) {
+            st->spill_path[0] = 0;
+        } else if (strcmp(argv[i], "--uplink-spill-mb") == 0 && i + 1 < argc) {
+            long mb = atol(argv[i + 1]);
+            if (mb > 0) st->spill_max = (size_t)mb * 1024u * 1024u;
+            i++;
+        } else if (strcmp(argv[i], "--webhook") == 0 && i + 1 < argc) {
+            if (st->nwebhooks < MAX_WEBHOOKS) {
+                snprintf(st->webhook_urls[st->nwebhooks++], sizeof(st->webhook_urls[0]), "%s", argv[i + 1]);
+            } else {
+                LOG_WARN("Ignoring webhook %s: at most %d are supported", argv[i + 1], MAX_WEBHOOKS);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--dead-letter") == 0 && i + 1 < argc) {
+            snprintf(st->dead_letter_path, sizeof(st->dead_letter_path), "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--pin-cores") == 0 && i + 1 < argc) {
+            // "R,P,U": cores for the reader, parser and publisher stages (missing entries stay unpinned)
+            const char* p = argv[i + 1];
+            for (int k = 0; k < 3 && *p; k++) {
+                char* end;
+                long core = strtol(p, &end, 10);
+                if (end != p) st->pin_cores[k] = (int)core;
+                p = (*end == ',') ? end + 1 : end;
+            }
+            i++;
         } else if (strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             exit(0);
@@ -76,22 +167,61 @@ static void parse_args(int argc, char** argv, SharedState* st) {
 
 int main(int argc, char** argv) {
     SharedState st;
+    size_t history_cap = HISTORY_DEFAULT_CAPACITY;
     init_defaults(&st);
-    parse_args(argc, argv, &st);
+    parse_args(argc, argv, &st, &history_cap);
 
+    static const char* mode_names[] = { "sim", "tcp", "listen" };
     LOG_INFO("AquaGuard starting: mode=%s, tcp=%s:%d, web=:%d",
-        st.mode_tcp ? "tcp" : "sim", st.tcp_host, st.tcp_port, st.web_port);
+        mode_names[st.mode], st.tcp_host, st.tcp_port, st.web_port);
+
+    // Per-device state: listen mode gets one slice per shard (devices spread by id), other modes one
+    if (st.nshards < 1) st.nshards = 1;
+    if (st.nshards > MAX_SHARDS) st.nshards = MAX_SHARDS;
+    if (!sensor_id_valid(st.uplink_id)) {
+        LOG_ERR("--uplink-id must be printable ASCII without '\"' or '\\'");
+        return 1;
+    }
+    if (state_init_slices(&st, st.mode == MODE_LISTEN ? st.nshards : 1) != 0 ||
+        state_init_history(&st, history_cap) != 0) {
+        LOG_ERR("Out of memory");
+        return 1;
+    }
+    if (st.mode == MODE_LISTEN) {
+        snprintf(st.data.via, sizeof(st.data.via), "LISTEN");
+        st.uplink_peers = uplink_peers_create(); // edge gateways may forward to this one
+    }
+
+    // Warm start: restore the last snapshot before the HTTP thread starts,
+    // so the very first dashboard frame already shows the previous readings.
+    if (st.snapshot_path[0]) snapshot_load(&st, st.snapshot_path);
 
     // Set up signals before threads start so we can quit cleanly
     signal(SIGINT, on_sigint);
+    signal(SIGTERM, on_sigint);
     ignore_sigpipe();
 
+    // Alert webhooks and forwarding start before ingest so the very first samples are covered
+    if (st.nwebhooks > 0) {
+        st.notify = notify_start(&st, NOTIFY_MAX_ATTEMPTS, NOTIFY_BACKOFF_MS);
+        if (!st.notify) LOG_ERR("Alert webhooks could not start; continuing without them");
+    }
+    st.subs = subs_create(&st); // filtered /events; served by the HTTP thread's hub thread
+    if (!st.subs) LOG_ERR("Filtered /events streams could not start; plain /events still works");
+    if (st.uplink_port > 0) {
+        st.uplink = uplink_start(&st, st.uplink_host, st.uplink_port, st.uplink_id, st.spill_path, st.spill_max);
+        if (!st.uplink) LOG_ERR("Uplink could not start; continuing without it");
+    }
+
     // Start background threads:
     // - sensor thread pulls data (TCP or simulator) and writes into SharedState
     // - HTTP thread reads from SharedState to serve the dashboard + live updates
+    // - listen mode replaces the sensor thread with N ingest shards (src/ingest.c)
     // Threads + mutex were picked over message queues to stay minimal and portable.
     pthread_t th_sensor, th_http;
-    if (st.mode_tcp) {
+    if (st.mode == MODE_LISTEN) {
+        if (ingest_start(&st) != 0) return 1;
+    } else if (st.mode == MODE_TCP) {
         pthread_create(&th_sensor, NULL, sensor_thread_tcp, &st);
     } else {
         pthread_create(&th_sensor, NULL, sensor_thread_sim, &st);
@@ -103,6 +233,28 @@ int main(int argc, char** argv) {
         sleep(1);
     }
 
+    // Graceful shutdown: every thread polls st.stop, so join them all before dumping state.
+    // The HTTP thread goes first: it returns only once its client threads (/events, /export,
+    // /stats, ...) are gone, so nothing reads the shards, history, slices or uplink/alert state
+    // freed below.
     LOG_INFO("Shutting down...");
+    atomic_store(&st.stop, 1);
+    pthread_join(th_http, NULL);
+    if (st.mode == MODE_LISTEN) ingest_stop(&st);
+    else pthread_join(th_sensor, NULL);
+    // No more producers: the uplink flushes to the aggregator (or its spill file) last
+    uplink_stop(st.uplink);
+    st.uplink = NULL;
+    notify_stop(st.notify); // delivers or dead-letters the alerts still pending
+    st.notify = NULL;
+    subs_destroy(st.subs);  // its thread went with the HTTP thread; closes the subscriber sockets
+    st.subs = NULL;
+
+    if (st.snapshot_path[0]) snapshot_write(&st, st.snapshot_path);
+    history_free(st.history);
+    free(st.history);
+    free(st.slices);
+    uplink_peers_free(st.uplink_peers);
+    LOG_INFO("Bye");
     return 0;
 }
@@ -0,0 +1,638 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include "notify.h"
+#include "serialize.h"
+#include "log.h"
+
+// Webhook dispatcher (see notify.h).
+// The ingest side touches only the queue (one short lock, no I/O). The fan-out thread moves
+// queued events into each destination's pending ring; everything that can block, connecting,
+// sending and waiting for responses, happens on that destination's own worker thread, so a
+// receiver that stops answering delays only its own events.
+
+#define EVENT_JSON_MAX 1024             // fits the longest event (every alert bit, 40-digit readings)
+#define LATENCY_BUCKETS 32               // log2 microsecond buckets
+#define BODY_CAP (256 + (size_t)NOTIFY_BATCH_MAX * (EVENT_JSON_MAX + 1))
+
+typedef struct {
+    Notifier* n;
+    char url[256];
+    char host[128];
+    int port;
+    char path[128];
+    int fd;                              // keep-alive connection, -1 when closed
+    pthread_t th;
+    char* body;                          // request body scratch (worker only)
+
+    pthread_mutex_t mu;                  // guards the pending ring (fan-out pushes, worker pops)
+    pthread_cond_t cv;                   // signalled when the ring stops being empty
+    AlertEvent* pending;                 // ring of NOTIFY_DEST_PENDING events
+    size_t phead;
+    size_t plen;
+    int attempts;                        // failed tries of the batch at the head (worker only)
+    uint64_t next_try_ms;                // worker only
+
+    // Guarded by Notifier.smu (read by /stats)
+    char last_error[64];
+    uint64_t requests;
+    uint64_t connections;
+    uint64_t reused;
+    uint64_t delivered;
+    uint64_t failures;
+} Destination;
+
+struct Notifier {
+    SharedState* st;
+    int max_attempts;
+    int backoff_ms;
+    pthread_t th;                        // fan-out thread
+    atomic_int stop;                     // fan-out: take what is queued and exit
+    atomic_int fanout_done;              // workers: nothing more will arrive, finish up and exit
+
+    // Ingest -> fan-out queue
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    AlertEvent* q;
+    size_t qhead;
+    size_t qlen;
+
+    Destination dests[MAX_WEBHOOKS];
+    int ndests;
+    int nworkers;                        // destination threads started
+    AlertEvent* drained;                 // events taken from the queue in one go
+    pthread_mutex_t dlmu;                // serialises dead-letter file appends across workers
+
+    pthread_mutex_t smu;                 // guards the metrics below and Destination counters
+    size_t queue_max;
+    uint64_t detected;
+    uint64_t dropped;                    // queue full or too many edges in one batch
+    uint64_t delivered;
+    uint64_t retries;
+    uint64_t dead_lettered;
+    uint64_t lat_count;
+    uint64_t lat_sum_us;
+    uint64_t lat_max_us;
+    uint64_t lat_hist[LATENCY_BUCKETS];
+};
+
+static uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static uint64_t mono_ms(void) {
+    return mono_us() / 1000u;
+}
+
+static void cond_wait_ms(pthread_cond_t* cv, pthread_mutex_t* mu, uint64_t wait_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += (time_t)(wait_ms / 1000u);
+    ts.tv_nsec += (long)(wait_ms % 1000u) * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(cv, mu, &ts);
+}
+
+// Only plain http:// is supported (receivers are expected on the local network or behind a proxy)
+static int parse_url(Destination* d, const char* url) {
+    snprintf(d->url, sizeof(d->url), "%s", url);
+    if (strncmp(url, "http://", 7) != 0) return -1;
+    const char* h = url + 7;
+    size_t hl = strcspn(h, ":/");
+    if (hl == 0 || hl >= sizeof(d->host)) return -1;
+    memcpy(d->host, h, hl);
+    d->host[hl] = 0;
+    const char* p = h + hl;
+    d->port = 80;
+    if (*p == ':') {
+        d->port = atoi(p + 1);
+        p += 1 + strspn(p + 1, "0123456789");
+    }
+    if (d->port <= 0 || d->port > 65535) return -1;
+    snprintf(d->path, sizeof(d->path), "%s", *p ? p : "/");
+    return d->path[0] == '/' ? 0 : -1;
+}
+
+void notify_publish(Notifier* n, const SensorData* samples, const AlertTransition* tr, int ntr, uint64_t ts_ms) {
+    int kept = ntr < NOTIFY_TRANSITIONS_PER_BATCH ? ntr : NOTIFY_TRANSITIONS_PER_BATCH;
+    int lost = ntr - kept;
+    uint64_t now_us = mono_us();
+
+    pthread_mutex_lock(&n->mu);
+    int was_empty = n->qlen == 0;
+    for (int i = 0; i < kept; i++) {
+        if (n->qlen == NOTIFY_QUEUE_CAP) { lost++; continue; }
+        const SensorData* s = &samples[tr[i].index];
+        AlertEvent* e = &n->q[(n->qhead + n->qlen) % NOTIFY_QUEUE_CAP];
+        snprintf(e->sensor_id, sizeof(e->sensor_id), "%s", s->sensor_id);
+        e->prev_mask = tr[i].prev_mask;
+        e->mask = s->alerts_mask;
+        e->flow_lpm = s->flow_lpm;
+        e->humidity_pct = s->humidity_pct;
+        e->temperature_c = s->temperature_c;
+        e->pressure_kpa = s->pressure_kpa;
+        e->ts_ms = ts_ms;
+        e->enq_us = now_us;
+        n->qlen++;
+    }
+    size_t depth = n->qlen;
+    if (was_empty && depth > 0) pthread_cond_signal(&n->cv);
+    pthread_mutex_unlock(&n->mu);
+
+    pthread_mutex_lock(&n->smu);
+    n->detected += (uint64_t)ntr;
+    n->dropped += (uint64_t)lost;
+    if (depth > n->queue_max) n->queue_max = depth;
+    pthread_mutex_unlock(&n->smu);
+}
+
+// A reading as JSON: two decimals, or null for NaN/inf (which JSON cannot spell)
+static const char* reading_json(float v, char* buf, size_t cap) {
+    if (!isfinite(v)) return "null";
+    snprintf(buf, cap, "%.2f", v);
+    return buf;
+}
+
+static size_t format_event(const AlertEvent* e, char* out, size_t cap) {
+    size_t lr, lc, la;
+    const char* raised = alert_list_json((AlertFlags)(e->mask & ~e->prev_mask), &lr);
+    const char* cleared = alert_list_json((AlertFlags)(e->prev_mask & ~e->mask), &lc);
+    const char* alerts = alert_list_json(e->mask, &la);
+    char f[48], h[48], t[48], p[48];
+    int n = snprintf(out, cap,
+        "{ \"sensor_id\": \"%s\", \"ts_ms\": %llu, \"raised\": %.*s, \"cleared\": %.*s, \"alerts\": %.*s, "
+        "\"alerts_mask\": %d, \"flow_lpm\": %s, \"humidity_pct\": %s, \"temperature_c\": %s, \"pressure_kpa\": %s }",
+        e->sensor_id, (unsigned long long)e->ts_ms, (int)lr, raised, (int)lc, cleared, (int)la, alerts,
+        (int)e->mask, reading_json(e->flow_lpm, f, sizeof(f)), reading_json(e->humidity_pct, h, sizeof(h)),
+        reading_json(e->temperature_c, t, sizeof(t)), reading_json(e->pressure_kpa, p, sizeof(p)));
+    return (n < 0 || (size_t)n >= cap) ? 0 : (size_t)n;
+}
+
+static AlertEvent* pending_at(Destination* d, size_t i) {
+    return &d->pending[(d->phead + i) % NOTIFY_DEST_PENDING];
+}
+
+// Copy up to NOTIFY_BATCH_MAX events from the head of the ring; returns how many
+static size_t pending_peek(Destination* d, AlertEvent* batch) {
+    pthread_mutex_lock(&d->mu);
+    size_t k = d->plen < NOTIFY_BATCH_MAX ? d->plen : NOTIFY_BATCH_MAX;
+    for (size_t i = 0; i < k; i++) batch[i] = *pending_at(d, i);
+    pthread_mutex_unlock(&d->mu);
+    return k;
+}
+
+static void pending_pop(Destination* d, size_t k) {
+    pthread_mutex_lock(&d->mu);
+    d->phead = (d->phead + k) % NOTIFY_DEST_PENDING;
+    d->plen -= k;
+    pthread_mutex_unlock(&d->mu);
+}
+
+static void set_error(Notifier* n, Destination* d, const char* what, int code) {
+    pthread_mutex_lock(&n->smu);
+    if (code) snprintf(d->last_error, sizeof(d->last_error), "%s %d", what, code);
+    else snprintf(d->last_error, sizeof(d->last_error), "%s", what);
+    pthread_mutex_unlock(&n->smu);
+}
+
+// Append events to the dead-letter file, one JSON object per line
+// attempts is passed in because d->attempts belongs to the worker and the fan-out calls this too.
+static void dead_letter(Notifier* n, Destination* d, const AlertEvent* evs, size_t count, const char* why, int attempts) {
+    pthread_mutex_lock(&n->dlmu);
+    FILE* f = n->st->dead_letter_path[0] ? fopen(n->st->dead_letter_path, "a") : NULL;
+    if (f) {
+        char ev[EVENT_JSON_MAX];
+        for (size_t i = 0; i < count; i++) {
+            if (format_event(&evs[i], ev, sizeof(ev)) == 0) continue;
+            fprintf(f, "{ \"destination\": \"%s\", \"error\": \"%s\", \"attempts\": %d, \"event\": %s }\n",
+                    d->url, why, attempts, ev);
+        }
+        fclose(f);
+    }
+    pthread_mutex_unlock(&n->dlmu);
+    LOG_WARN("Webhook %s: %zu alert event%s dead-lettered (%s)", d->url, count, count == 1 ? "" : "s", why);
+    pthread_mutex_lock(&n->smu);
+    n->dead_lettered += count;
+    pthread_mutex_unlock(&n->smu);
+}
+
+static void dest_push(Notifier* n, Destination* d, const AlertEvent* e) {
+    pthread_mutex_lock(&d->mu);
+    int full = d->plen == NOTIFY_DEST_PENDING;
+    if (!full) {
+        *pending_at(d, d->plen) = *e;
+        if (d->plen++ == 0) pthread_cond_signal(&d->cv);
+    }
+    pthread_mutex_unlock(&d->mu);
+    // Receiver far behind: the new event goes straight to the dead-letter file
+    if (full) dead_letter(n, d, e, 1, "pending queue full", 0);
+}
+
+static void dest_close(Destination* d) {
+    if (d->fd >= 0) close(d->fd);
+    d->fd = -1;
+}
+
+static int dest_connect(Notifier* n, Destination* d) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", d->port);
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(d->host, port, &hints, &res) != 0 || !res) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) { freeaddrinfo(res); return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        rc = (poll(&pfd, 1, NOTIFY_IO_TIMEOUT_MS) == 1 &&
+              getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) == 0 && err == 0) ? 0 : -1;
+    }
+    if (rc != 0) { close(fd); return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = { .tv_sec = NOTIFY_IO_TIMEOUT_MS / 1000, .tv_usec = (NOTIFY_IO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    d->fd = fd;
+    pthread_mutex_lock(&n->smu);
+    d->connections++;
+    pthread_mutex_unlock(&n->smu);
+    return 0;
+}
+
+// Read one response. Returns the HTTP status, or -1 on I/O or framing errors.
+// *keep says whether the connection can carry the next request.
+static int read_response(int fd, int* keep) {
+    char buf[4096];
+    size_t len = 0;
+    char* end = NULL;
+    while (!end) {
+        if (len == sizeof(buf) - 1) return -1;
+        ssize_t r = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        len += (size_t)r;
+        buf[len] = 0;
+        end = strstr(buf, "\r\n\r\n");
+    }
+
+    int status = 0;
+    if (sscanf(buf, "HTTP/1.%*d %d", &status) != 1) return -1;
+    long clen = -1;
+    *keep = strncmp(buf, "HTTP/1.1", 8) == 0;
+    for (char* line = strstr(buf, "\r\n"); line && line < end; line = strstr(line + 2, "\r\n")) {
+        const char* h = line + 2;
+        if (strncasecmp(h, "Content-Length:", 15) == 0) clen = atol(h + 15);
+        else if (strncasecmp(h, "Connection:", 11) == 0) {
+            const char* v = h + 11 + strspn(h + 11, " ");
+            if (strncasecmp(v, "close", 5) == 0) *keep = 0;
+            else if (strncasecmp(v, "keep-alive", 10) == 0) *keep = 1;
+        }
+    }
+    if (clen < 0) {
+        // Without a length only the end of the connection delimits the body
+        if (status != 204 && status != 304) *keep = 0;
+        return status;
+    }
+
+    // Discard the body so the next response starts at a clean boundary
+    size_t have = len - (size_t)(end + 4 - buf);
+    while ((long)have < clen) {
+        ssize_t r = read(fd, buf, sizeof(buf) - 1 < (size_t)(clen - (long)have) ? sizeof(buf) - 1 : (size_t)(clen - (long)have));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        have += (size_t)r;
+    }
+    return status;
+}
+
+// POST the body on the destination's connection (dialing one if needed).
+// Returns the HTTP status, or -1 if the request could not be completed.
+static int post_batch(Notifier* n, Destination* d, size_t body_len) {
+    for (int round = 0; round < 2; round++) {
+        int reused = d->fd >= 0;
+        if (!reused && dest_connect(n, d) != 0) {
+            set_error(n, d, "connect failed", 0);
+            return -1;
+        }
+
+        char hdr[512];
+        int hl = snprintf(hdr, sizeof(hdr),
+            "POST %s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n"
+            "Connection: keep-alive\r\n\r\n", d->path, d->host, d->port, body_len);
+        struct iovec iov[2] = { { hdr, (size_t)hl }, { d->body, body_len } };
+        size_t total = (size_t)hl + body_len;
+        ssize_t w = writev(d->fd, iov, 2);
+        int keep = 0;
+        int status = (w == (ssize_t)total) ? read_response(d->fd, &keep) : -1;
+
+        pthread_mutex_lock(&n->smu);
+        d->requests++;
+        if (reused) d->reused++;
+        pthread_mutex_unlock(&n->smu);
+
+        if (status < 0) {
+            dest_close(d);
+            // A kept-alive connection the receiver already closed is not a delivery failure:
+            // try once more on a fresh connection before counting an attempt.
+            if (reused) continue;
+            set_error(n, d, "no response", 0);
+            return -1;
+        }
+        if (!keep) dest_close(d);
+        return status;
+    }
+    return -1;
+}
+
+static void record_latency(Notifier* n, const AlertEvent* evs, size_t count) {
+    uint64_t now = mono_us();
+    pthread_mutex_lock(&n->smu);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t us = now > evs[i].enq_us ? now - evs[i].enq_us : 0;
+        int b = 0;
+        while (b < LATENCY_BUCKETS - 1 && (us >> (b + 1)) > 0) b++;
+        n->lat_hist[b]++;
+        n->lat_sum_us += us;
+        if (us > n->lat_max_us) n->lat_max_us = us;
+    }
+    n->lat_count += count;
+    n->delivered += count;
+    pthread_mutex_unlock(&n->smu);
+}
+
+// Send the batch at the head of the destination's pending ring
+static void dest_send(Notifier* n, Destination* d) {
+    AlertEvent batch[NOTIFY_BATCH_MAX];
+    size_t k = pending_peek(d, batch);
+    if (k == 0) return;
+
+    size_t used = (size_t)snprintf(d->body, BODY_CAP, "{ \"gateway\": \"%s\", \"events\": [", n->st->uplink_id);
+    size_t sent = 0;
+    for (size_t i = 0; i < k; i++) {
+        // Format aside first so an event that does not fit never leaves a dangling comma
+        char ev[EVENT_JSON_MAX];
+        size_t len = format_event(&batch[i], ev, sizeof(ev));
+        if (len == 0 || used + len + 8 > BODY_CAP) {
+            LOG_WARN("Webhook %s: alert event for %s does not fit a request, skipped", d->url, batch[i].sensor_id);
+            continue;
+        }
+        if (sent++) d->body[used++] = ',';
+        memcpy(d->body + used, ev, len);
+        used += len;
+    }
+    used += (size_t)snprintf(d->body + used, BODY_CAP - used, "] }");
+
+    int status = post_batch(n, d, used);
+    if (status >= 200 && status < 300) {
+        pending_pop(d, k);
+        d->attempts = 0;
+        d->next_try_ms = 0;
+        record_latency(n, batch, k);
+        pthread_mutex_lock(&n->smu);
+        d->delivered += k;
+        pthread_mutex_unlock(&n->smu);
+        return;
+    }
+
+    if (status > 0) set_error(n, d, "HTTP", status);
+    d->attempts++;
+    pthread_mutex_lock(&n->smu);
+    d->failures++;
+    pthread_mutex_unlock(&n->smu);
+    if (d->attempts >= n->max_attempts) {
+        char why[sizeof(d->last_error)];
+        pthread_mutex_lock(&n->smu);
+        memcpy(why, d->last_error, sizeof(why));
+        pthread_mutex_unlock(&n->smu);
+        dead_letter(n, d, batch, k, why, d->attempts);
+        pending_pop(d, k);
+        d->attempts = 0;
+        d->next_try_ms = 0;
+        return;
+    }
+
+    // Exponential backoff: backoff_ms, 2x, 4x, ... capped
+    uint64_t delay = (uint64_t)n->backoff_ms << (d->attempts - 1);
+    if (delay > NOTIFY_BACKOFF_MAX_MS) delay = NOTIFY_BACKOFF_MAX_MS;
+    d->next_try_ms = mono_ms() + delay;
+    pthread_mutex_lock(&n->smu);
+    n->retries++;
+    pthread_mutex_unlock(&n->smu);
+}
+
+// Move everything queued by ingest into the per-destination rings. Waits up to wait_ms for work.
+static void take_queue(Notifier* n, int wait_ms) {
+    pthread_mutex_lock(&n->mu);
+    if (n->qlen == 0 && wait_ms > 0 && !atomic_load(&n->stop)) cond_wait_ms(&n->cv, &n->mu, (uint64_t)wait_ms);
+    size_t count = n->qlen;
+    for (size_t i = 0; i < count; i++) n->drained[i] = n->q[(n->qhead + i) % NOTIFY_QUEUE_CAP];
+    n->qhead = (n->qhead + count) % NOTIFY_QUEUE_CAP;
+    n->qlen = 0;
+    pthread_mutex_unlock(&n->mu);
+
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < n->ndests; j++) dest_push(n, &n->dests[j], &n->drained[i]);
+    }
+}
+
+static size_t pending_len(Destination* d) {
+    pthread_mutex_lock(&d->mu);
+    size_t len = d->plen;
+    pthread_mutex_unlock(&d->mu);
+    return len;
+}
+
+// Worker for one destination: sends whenever events are pending and no backoff is running
+static void* dest_main(void* arg) {
+    Destination* d = (Destination*)arg;
+    Notifier* n = d->n;
+    while (!atomic_load(&n->fanout_done)) {
+        pthread_mutex_lock(&d->mu);
+        uint64_t now = mono_ms();
+        if (!atomic_load(&n->fanout_done) && (d->plen == 0 || now < d->next_try_ms))
+            cond_wait_ms(&d->cv, &d->mu, d->plen == 0 ? 1000 : d->next_try_ms - now);
+        int due = d->plen > 0 && mono_ms() >= d->next_try_ms;
+        pthread_mutex_unlock(&d->mu);
+        if (due) dest_send(n, d);
+    }
+
+    // Shutdown: one bounded attempt for whatever is left (ignoring backoff), then dead-letter it
+    uint64_t deadline = mono_ms() + NOTIFY_IO_TIMEOUT_MS;
+    while (pending_len(d) > 0 && mono_ms() < deadline) {
+        size_t before = pending_len(d);
+        d->next_try_ms = 0;
+        dest_send(n, d);
+        if (pending_len(d) == before) break; // failed: no point retrying right away
+    }
+    AlertEvent batch[NOTIFY_BATCH_MAX];
+    size_t k;
+    while ((k = pending_peek(d, batch)) > 0) {
+        dead_letter(n, d, batch, k, "shutdown", d->attempts);
+        pending_pop(d, k);
+    }
+    dest_close(d);
+    return NULL;
+}
+
+// Fan-out: copies every queued event into each destination's ring until stopped
+static void* notify_main(void* arg) {
+    Notifier* n = (Notifier*)arg;
+    while (!atomic_load(&n->stop)) take_queue(n, 100);
+    take_queue(n, 0);
+    return NULL;
+}
+
+// Tell the workers nothing more is coming and wait for their last attempt
+static void workers_finish(Notifier* n) {
+    atomic_store(&n->fanout_done, 1);
+    for (int i = 0; i < n->nworkers; i++) {
+        Destination* d = &n->dests[i];
+        pthread_mutex_lock(&d->mu);
+        pthread_cond_signal(&d->cv);
+        pthread_mutex_unlock(&d->mu);
+        pthread_join(d->th, NULL);
+    }
+}
+
+static void notifier_free(Notifier* n) {
+    for (int i = 0; i < n->ndests; i++) {
+        Destination* d = &n->dests[i];
+        pthread_mutex_destroy(&d->mu);
+        pthread_cond_destroy(&d->cv);
+        free(d->pending);
+        free(d->body);
+    }
+    pthread_mutex_destroy(&n->mu);
+    pthread_cond_destroy(&n->cv);
+    pthread_mutex_destroy(&n->smu);
+    pthread_mutex_destroy(&n->dlmu);
+    free(n->q);
+    free(n->drained);
+    free(n);
+}
+
+Notifier* notify_start(SharedState* st, int max_attempts, int backoff_ms) {
+    Notifier* n = calloc(1, sizeof(Notifier));
+    if (!n) return NULL;
+    n->st = st;
+    n->max_attempts = max_attempts > 0 ? max_attempts : 1;
+    n->backoff_ms = backoff_ms > 0 ? backoff_ms : 1;
+    int ok = 1;
+    for (int i = 0; i < st->nwebhooks && i < MAX_WEBHOOKS; i++) {
+        Destination* d = &n->dests[n->ndests];
+        if (parse_url(d, st->webhook_urls[i]) != 0) {
+            LOG_ERR("Webhook URL %s not understood (expected http://host[:port][/path])", st->webhook_urls[i]);
+            continue;
+        }
+        d->n = n;
+        d->fd = -1;
+        pthread_mutex_init(&d->mu, NULL);
+        pthread_cond_init(&d->cv, NULL);
+        d->pending = malloc(sizeof(AlertEvent) * NOTIFY_DEST_PENDING);
+        d->body = malloc(BODY_CAP);
+        n->ndests++;
+        if (!d->pending || !d->body) { ok = 0; break; }
+    }
+    n->q = malloc(sizeof(AlertEvent) * NOTIFY_QUEUE_CAP);
+    n->drained = malloc(sizeof(AlertEvent) * NOTIFY_QUEUE_CAP);
+    pthread_mutex_init(&n->mu, NULL);
+    pthread_cond_init(&n->cv, NULL);
+    pthread_mutex_init(&n->smu, NULL);
+    pthread_mutex_init(&n->dlmu, NULL);
+
+    ok = ok && n->ndests > 0 && n->q && n->drained;
+    while (ok && n->nworkers < n->ndests) {
+        Destination* d = &n->dests[n->nworkers];
+        if (pthread_create(&d->th, NULL, dest_main, d) != 0) ok = 0;
+        else n->nworkers++;
+    }
+    if (!ok || pthread_create(&n->th, NULL, notify_main, n) != 0) {
+        workers_finish(n);
+        notifier_free(n);
+        return NULL;
+    }
+    for (int i = 0; i < n->ndests; i++) LOG_INFO("Alert webhook: %s", n->dests[i].url);
+    return n;
+}
+
+void notify_stop(Notifier* n) {
+    if (!n) return;
+    atomic_store(&n->stop, 1);
+    pthread_mutex_lock(&n->mu);
+    pthread_cond_signal(&n->cv);
+    pthread_mutex_unlock(&n->mu);
+    pthread_join(n->th, NULL);
+    workers_finish(n);
+    notifier_free(n);
+}
+
+// Upper edge of the histogram bucket holding the given quantile, in ms
+static double latency_quantile_ms(const Notifier* n, double q) {
+    if (n->lat_count == 0) return 0.0;
+    uint64_t rank = (uint64_t)((double)n->lat_count * q);
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += n->lat_hist[b];
+        if (seen > rank) return (double)(2ull << b) / 1000.0;
+    }
+    return (double)n->lat_max_us / 1000.0;
+}
+
+int notify_stats_json(Notifier* n, char* out, size_t outsz) {
+    pthread_mutex_lock(&n->mu);
+    size_t depth = n->qlen;
+    pthread_mutex_unlock(&n->mu);
+
+    size_t pending[MAX_WEBHOOKS];
+    for (int i = 0; i < n->ndests; i++) pending[i] = pending_len(&n->dests[i]);
+
+    pthread_mutex_lock(&n->smu);
+    int len = snprintf(out, outsz,
+        "{ \"queue_depth\": %zu, \"queue_max\": %zu, \"queue_cap\": %d, \"detected\": %llu, \"dropped\": %llu, "
+        "\"delivered\": %llu, \"retries\": %llu, \"dead_lettered\": %llu, "
+        "\"latency_ms\": { \"avg\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f }, \"destinations\": [",
+        depth, n->queue_max, NOTIFY_QUEUE_CAP, (unsigned long long)n->detected, (unsigned long long)n->dropped,
+        (unsigned long long)n->delivered, (unsigned long long)n->retries, (unsigned long long)n->dead_lettered,
+        n->lat_count ? (double)n->lat_sum_us / (double)n->lat_count / 1000.0 : 0.0,
+        latency_quantile_ms(n, 0.50), latency_quantile_ms(n, 0.99), (double)n->lat_max_us / 1000.0);
+    for (int i = 0; i < n->ndests && len >= 0 && (size_t)len < outsz; i++) {
+        Destination* d = &n->dests[i];
+        len += snprintf(out + len, outsz - (size_t)len,
+            "%s{ \"url\": \"%s\", \"pending\": %zu, \"requests\": %llu, \"connections\": %llu, \"reused\": %llu, "
+            "\"delivered\": %llu, \"failures\": %llu, \"last_error\": \"%s\" }",
+            i ? ", " : "", d->url, pending[i], (unsigned long long)d->requests, (unsigned long long)d->connections,
+            (unsigned long long)d->reused, (unsigned long long)d->delivered, (unsigned long long)d->failures,
+            d->last_error);
+    }
+    pthread_mutex_unlock(&n->smu);
+    if (len < 0 || (size_t)len >= outsz) return -1;
+    int tail = snprintf(out + len, outsz - (size_t)len, "] }");
+    if (tail < 0 || (size_t)tail >= outsz - (size_t)len) return -1;
+    return len + tail;
+}
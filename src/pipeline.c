@@ -0,0 +1,290 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np / CPU_SET
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "json.h"
+#include "state.h"
+#include "log.h"
+
+// Three-stage ingest pipeline for TCP mode.
+//   reader    (sensor thread): socket bytes -> LineBatch      (pipeline_feed / pipeline_flush)
+//   parser    (own thread):    LineBatch    -> SampleBatch    (parse_sensor_json)
+//   publisher (own thread):    SampleBatch  -> SharedState    (state_publish_batch, one lock per batch)
+// Each hop is a single-producer/single-consumer ring, so no stage ever waits on a mutex owned by another.
+
+// Idle/backpressure wait: spin briefly with yields, then sleep so an idle pipeline costs no CPU.
+static void stage_wait(int* spins) {
+    if (*spins < 64) {
+        (*spins)++;
+        sched_yield();
+    } else {
+        usleep(500);
+    }
+}
+
+static void note_depth(SpscRing* r, atomic_size_t* max_seen) {
+    size_t d = spsc_depth(r);
+    if (d > atomic_load_explicit(max_seen, memory_order_relaxed)) {
+        atomic_store_explicit(max_seen, d, memory_order_relaxed); // single producer writes it
+    }
+}
+
+int pipeline_pin_self(int core) {
+    if (core < 0) return 0;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        LOG_WARN("Could not pin thread to core %d (rc=%d)", core, rc);
+        return -1;
+    }
+    return 0;
+#else
+    LOG_WARN("Core pinning is only supported on Linux; ignoring core %d", core);
+    return -1;
+#endif
+}
+
+// ---- reader side ----------------------------------------------------------
+
+// Block until the parser frees a slot; the socket simply stays unread meanwhile.
+static LineBatch* reader_batch(IngestPipeline* p) {
+    if (p->cur) return p->cur;
+    int spins = 0;
+    LineBatch* b;
+    while (!(b = spsc_acquire_write(&p->lines))) stage_wait(&spins);
+    b->count = 0;
+    b->used = 0;
+    b->conn_event = PIPE_NO_EVENT;
+    p->cur = b;
+    return b;
+}
+
+void pipeline_flush(IngestPipeline* p) {
+    if (!p->cur) return;
+    p->cur = NULL;
+    spsc_commit_write(&p->lines);
+    note_depth(&p->lines, &p->line_depth_max);
+}
+
+static void reader_push_line(IngestPipeline* p) {
+    LineBatch* b = reader_batch(p);
+    if (b->count == PIPE_BATCH_MAX || b->used + p->partial_len + 1 > sizeof(b->data)) {
+        pipeline_flush(p);
+        b = reader_batch(p);
+    }
+    b->off[b->count++] = (uint16_t)b->used;
+    memcpy(b->data + b->used, p->partial, p->partial_len);
+    b->data[b->used + p->partial_len] = 0;
+    b->used += p->partial_len + 1;
+    p->partial_len = 0;
+    atomic_fetch_add_explicit(&p->lines_read, 1, memory_order_relaxed);
+}
+
+// Same framing rule as before: newline ends a line, and an over-long line is cut at PIPE_MAX_LINE - 1.
+void pipeline_feed(IngestPipeline* p, const char* buf, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char c = buf[i];
+        if (c == '\n' || p->partial_len >= PIPE_MAX_LINE - 1) {
+            reader_push_line(p);
+        } else {
+            p->partial[p->partial_len++] = c;
+        }
+    }
+}
+
+void pipeline_conn_event(IngestPipeline* p, ConnectionStatus status) {
+    p->partial_len = 0;
+    LineBatch* b = reader_batch(p);
+    b->conn_event = (int)status;
+    pipeline_flush(p);
+}
+
+// ---- parser stage ---------------------------------------------------------
+
+// A gateway can multiplex several devices over the one connection, so the parser keeps each
+// device's last sample: optional fields a line leaves out carry forward from that device only.
+#define PARSER_IDS 256               // devices remembered per connection
+#define PARSER_PROBES 8              // past this a newcomer takes over its home slot
+
+// Slot holding id's last sample, or the slot it should take (sensor_id then differs)
+static SensorData* parser_slot(SensorData* last, const char* id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)id; *c; c++) h = (h ^ *c) * 16777619u;
+    uint32_t home = h % PARSER_IDS;
+    for (uint32_t k = 0; k < PARSER_PROBES; k++) {
+        SensorData* s = &last[(home + k) % PARSER_IDS];
+        if (!s->sensor_id[0] || strcmp(s->sensor_id, id) == 0) return s;
+    }
+    return &last[home];
+}
+
+// Parse a line against the sample it continues. A line naming another device than *cur is
+// parsed again from that device's own previous sample (a blank one if it is new), and *cur's
+// sample is put away until its device shows up again.
+static int parser_line(SensorData* last, SensorData* cur, const char* line) {
+    SensorData tmp = *cur;
+    if (parse_sensor_json(line, &tmp) != 0) return -1;
+    if (strcmp(tmp.sensor_id, cur->sensor_id) != 0) {
+        if (cur->sensor_id[0]) *parser_slot(last, cur->sensor_id) = *cur;
+        SensorData* prev = parser_slot(last, tmp.sensor_id);
+        if (strcmp(prev->sensor_id, tmp.sensor_id) == 0) {
+            tmp = *prev;
+        } else {
+            char id[sizeof(tmp.sensor_id)];
+            memcpy(id, tmp.sensor_id, sizeof(id));
+            memset(&tmp, 0, sizeof(tmp));
+            memcpy(tmp.sensor_id, id, sizeof(id));
+        }
+        if (parse_sensor_json(line, &tmp) != 0) return -1;
+    }
+    *cur = tmp;
+    return 0;
+}
+
+static void* parser_main(void* arg) {
+    IngestPipeline* p = (IngestPipeline*)arg;
+    pipeline_pin_self(p->st->pin_cores[PIPE_STAGE_PARSER]);
+
+    // The parser carries each device's previous reading forward itself (parser_line), so
+    // optional fields keep their last value without reading SharedState on every line.
+    SensorData cur;
+    pthread_mutex_lock(&p->st->mu);
+    cur = p->st->data;
+    pthread_mutex_unlock(&p->st->mu);
+
+    int spins = 0;
+    for (;;) {
+        LineBatch* in = spsc_acquire_read(&p->lines);
+        if (!in) {
+            if (atomic_load(&p->stop)) break;
+            stage_wait(&spins);
+            continue;
+        }
+        spins = 0;
+
+        SampleBatch* out;
+        int out_spins = 0;
+        while (!(out = spsc_acquire_write(&p->samples))) stage_wait(&out_spins);
+        out->count = 0;
+        out->conn_event = in->conn_event;
+
+        for (int i = 0; i < in->count; i++) {
+            const char* line = in->data + in->off[i];
+            if (parser_line(p->parser_last, &cur, line) == 0) {
+                cur.conn = CONN_CONNECTED;
+                snprintf(cur.via, sizeof(cur.via), "TCP");
+                out->samples[out->count++] = cur;
+            } else {
+                atomic_fetch_add_explicit(&p->parse_errors, 1, memory_order_relaxed);
+            }
+        }
+        if (in->conn_event != PIPE_NO_EVENT) cur.conn = (ConnectionStatus)in->conn_event;
+        atomic_fetch_add_explicit(&p->samples_parsed, (uint_fast64_t)out->count, memory_order_relaxed);
+
+        spsc_release_read(&p->lines);
+        spsc_commit_write(&p->samples);
+        note_depth(&p->samples, &p->sample_depth_max);
+    }
+    return NULL;
+}
+
+// ---- publisher stage ------------------------------------------------------
+
+static void* publisher_main(void* arg) {
+    IngestPipeline* p = (IngestPipeline*)arg;
+    pipeline_pin_self(p->st->pin_cores[PIPE_STAGE_PUBLISHER]);
+
+    int spins = 0;
+    for (;;) {
+        SampleBatch* b = spsc_acquire_read(&p->samples);
+        if (!b) {
+            // Only quit once the parser has exited, so nothing it produced is lost
+            if (atomic_load(&p->stop) == 2) break;
+            stage_wait(&spins);
+            continue;
+        }
+        spins = 0;
+        state_publish_batch(p->st, b->samples, b->count);
+        if (b->conn_event != PIPE_NO_EVENT) {
+            state_set_connection(p->st, (ConnectionStatus)b->conn_event, "TCP");
+        }
+        atomic_fetch_add_explicit(&p->batches_published, 1, memory_order_relaxed);
+        spsc_release_read(&p->samples);
+    }
+    return NULL;
+}
+
+// ---- lifecycle ------------------------------------------------------------
+
+IngestPipeline* pipeline_start(SharedState* st) {
+    void* mem = NULL;
+    if (posix_memalign(&mem, 64, sizeof(IngestPipeline)) != 0) return NULL;
+    IngestPipeline* p = (IngestPipeline*)mem;
+    memset(p, 0, sizeof(*p));
+    p->st = st;
+    atomic_init(&p->stop, 0);
+
+    p->parser_last = calloc(PARSER_IDS, sizeof(SensorData));
+    if (!p->parser_last || spsc_init(&p->lines, PIPE_QUEUE_SLOTS, sizeof(LineBatch)) != 0) {
+        free(p->parser_last);
+        free(p);
+        return NULL;
+    }
+    if (spsc_init(&p->samples, PIPE_QUEUE_SLOTS, sizeof(SampleBatch)) != 0) {
+        spsc_free(&p->lines);
+        free(p->parser_last);
+        free(p);
+        return NULL;
+    }
+
+    int started = pthread_create(&p->parser_th, NULL, parser_main, p) == 0;
+    if (started && pthread_create(&p->publisher_th, NULL, publisher_main, p) != 0) {
+        // The parser exits as soon as it sees stop with an empty line queue
+        atomic_store(&p->stop, 1);
+        pthread_join(p->parser_th, NULL);
+        started = 0;
+    }
+    if (!started) {
+        spsc_free(&p->lines);
+        spsc_free(&p->samples);
+        free(p->parser_last);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void pipeline_stop(IngestPipeline* p) {
+    if (!p) return;
+    pipeline_flush(p);
+    atomic_store(&p->stop, 1);
+    pthread_join(p->parser_th, NULL);
+    atomic_store(&p->stop, 2);
+    pthread_join(p->publisher_th, NULL);
+    spsc_free(&p->lines);
+    spsc_free(&p->samples);
+    free(p->parser_last);
+    free(p);
+}
+
+int pipeline_stats_json(IngestPipeline* p, char* out, size_t outsz) {
+    return snprintf(out, outsz,
+        "{ \"line_queue_depth\": %zu, \"line_queue_max\": %zu, \"sample_queue_depth\": %zu, \"sample_queue_max\": %zu, "
+        "\"queue_capacity\": %zu, \"lines_read\": %llu, \"samples_parsed\": %llu, \"parse_errors\": %llu, \"batches_published\": %llu }",
+        spsc_depth(&p->lines), atomic_load(&p->line_depth_max),
+        spsc_depth(&p->samples), atomic_load(&p->sample_depth_max),
+        p->lines.capacity,
+        (unsigned long long)atomic_load(&p->lines_read),
+        (unsigned long long)atomic_load(&p->samples_parsed),
+        (unsigned long long)atomic_load(&p->parse_errors),
+        (unsigned long long)atomic_load(&p->batches_published));
+}
@@ -8,8 +8,10 @@
 #include <netdb.h>
 #include <time.h>
 #include <math.h>
+#include <poll.h>
 #include "sensor.h"
-#include "json.h"
+#include "pipeline.h"
+#include "state.h"
 #include "log.h"
 
 // This file feeds SensorData into the shared SharedState (used by both threads).
@@ -53,72 +55,76 @@ static int connect_tcp(const char* host, int port) {
     return -1;
 }
 
-// Helper to update connection fields together (with locking).
-// Also bumps last_seq so the HTTP thread knows data changed and should push an update.
-static void set_connection_status(SharedState* st, ConnectionStatus status, const char* via) {
-    pthread_mutex_lock(&st->mu);
-    st->data.conn = status;
-    if (via) snprintf(st->data.via, sizeof(st->data.via), "%s", via);
-    st->data.last_seq++;
-    pthread_mutex_unlock(&st->mu);
+// Sleep in short steps so a shutdown request is not held up by a long backoff
+static void sleep_unless_stopping(SharedState* st, int ms) {
+    while (ms > 0 && !state_stopping(st)) {
+        int step = ms < 100 ? ms : 100;
+        usleep(step * 1000);
+        ms -= step;
+    }
 }
 
 // Thread: read newline-separated JSON packets from the TCP simulator.
 // Newline framing was chosen because the simulator already sends one JSON per line—no extra protocol needed.
-// Each parsed packet overwrites SharedState so the dashboard shows fresh numbers.
+// This thread is only the reader stage: it frames bytes into line batches and hands them to the
+// parser/publisher stages (src/pipeline.c), so parsing and locking never hold up the socket.
 void* sensor_thread_tcp(void* arg) {
     SharedState* st = (SharedState*)arg;
-    const int max_line = 1024;
-    char buf[1024];
+    char buf[4096];
     int backoff_ms = 500;
 
-    for (;;) {
+    pipeline_pin_self(st->pin_cores[PIPE_STAGE_READER]);
+    IngestPipeline* pipe = pipeline_start(st);
+    if (!pipe) {
+        LOG_ERR("Could not allocate ingest pipeline");
+        return NULL;
+    }
+    pthread_mutex_lock(&st->mu);
+    st->pipeline = pipe;
+    pthread_mutex_unlock(&st->mu);
+
+    while (!state_stopping(st)) {
         int fd = connect_tcp(st->tcp_host, st->tcp_port);
         if (fd < 0) {
-            set_connection_status(st, CONN_DISCONNECTED, "TCP");
+            pipeline_conn_event(pipe, CONN_DISCONNECTED);
             LOG_WARN("Simulator not reachable at %s:%d; retrying...", st->tcp_host, st->tcp_port);
-            usleep(backoff_ms * 1000);
+            sleep_unless_stopping(st, backoff_ms);
             if (backoff_ms < 5000) backoff_ms *= 2; // exponential backoff to avoid hammering the host
             continue;
         }
 
         LOG_INFO("Connected to simulator %s:%d", st->tcp_host, st->tcp_port);
         backoff_ms = 500;
-        set_connection_status(st, CONN_CONNECTED, "TCP");
+        pipeline_conn_event(pipe, CONN_CONNECTED);
 
-        char line[1024]; // fixed-size buffer for incoming line
-        size_t idx = 0;
         for (;;) {
+            if (state_stopping(st)) {
+                close(fd);
+                break;
+            }
+            // Wait with a timeout so shutdown is noticed even on a silent connection
+            struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+            if (poll(&pfd, 1, 200) == 0) continue;
             ssize_t n = read(fd, buf, sizeof(buf));
             if (n <= 0) {
                 LOG_WARN("Simulator disconnected");
                 close(fd);
-                set_connection_status(st, CONN_DISCONNECTED, "TCP");
+                pipeline_conn_event(pipe, CONN_DISCONNECTED);
                 break; // reconnect loop
             }
 
-            // Collect characters until newline, then parse that line as JSON.
-            // When parsing succeeds, we store into st->data and bump last_seq to wake the HTTP thread.
-            for (ssize_t i = 0; i < n; i++) {
-                char c = buf[i];
-                if (c == '\n' || idx >= max_line - 1) {
-                    line[idx] = 0;
-                    SensorData tmp = st->data; // start from previous values so optional fields stay (simulate partial updates)
-                    if (parse_sensor_json(line, &tmp) == 0) {
-                        tmp.conn = CONN_CONNECTED;
-                        snprintf(tmp.via, sizeof(tmp.via), "TCP");
-                        pthread_mutex_lock(&st->mu);
-                        st->data = tmp;
-                        st->data.last_seq++;
-                        pthread_mutex_unlock(&st->mu);
-                    }
-                    idx = 0;
-                } else {
-                    line[idx++] = c;
-                }
-            }
+            // Frame whatever arrived into lines and pass the batch on right away,
+            // so a quiet stream still reaches the dashboard without waiting for a full batch.
+            pipeline_feed(pipe, buf, (size_t)n);
+            pipeline_flush(pipe);
         }
     }
+
+    // Let the parser/publisher drain what was already read, then tear the stages down
+    pthread_mutex_lock(&st->mu);
+    st->pipeline = NULL;
+    pthread_mutex_unlock(&st->mu);
+    pipeline_stop(pipe);
     return NULL;
 }
 
@@ -149,7 +155,7 @@ void* sensor_thread_sim(void* arg) {
     float temp = 22.0f;
     float pressure = 101.3f;
 
-    for (;;) {
+    while (!state_stopping(st)) {
         // Wander values a bit so the graph moves (adds randomness each cycle).
         // Clamp keeps the fake readings in a believable range.
         flow = clamp(flow + ((rand() % 200 - 100) / 1000.0f), 0.f, 50.f);
@@ -161,17 +167,18 @@ void* sensor_thread_sim(void* arg) {
         AlertFlags alerts = eval_alerts(flow, hum, temp, pressure);
 
         // Share the latest readings with the rest of the program
-        pthread_mutex_lock(&st->mu);
-        st->data.flow_lpm = flow;
-        st->data.humidity_pct = hum;
-        st->data.temperature_c = temp;
-        st->data.pressure_kpa = pressure;
-        st->data.flowing = flowing;
-        st->data.alerts_mask = alerts;
-        st->data.conn = CONN_CONNECTED;
-        snprintf(st->data.via, sizeof(st->data.via), "SIM");
-        st->data.last_seq++;
-        pthread_mutex_unlock(&st->mu);
+        SensorData sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.flow_lpm = flow;
+        sample.humidity_pct = hum;
+        sample.temperature_c = temp;
+        sample.pressure_kpa = pressure;
+        sample.flowing = flowing;
+        sample.alerts_mask = alerts;
+        sample.conn = CONN_CONNECTED;
+        snprintf(sample.via, sizeof(sample.via), "SIM");
+        snprintf(sample.sensor_id, sizeof(sample.sensor_id), "default");
+        state_publish_batch(st, &sample, 1);
 
         usleep(400 * 1000); // pause ~0.4s between readings (about 2.5 updates/second)
     }
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "serialize.h"
+
+// Fast path for the SSE payload. The layout mirrors the original snprintf template exactly:
+// { "flow_lpm": F, "humidity_pct": F, "temperature_c": F, "pressure_kpa": F, "alerts": [..],
+//   "connection": "..", "via": "..", "seq": N, "alert_summary": ".." }
+
+typedef struct {
+    const char* s;
+    size_t len;
+} StrRef;
+
+#define ENTRY(list, summary) { { list, sizeof(list) - 1 }, { summary, sizeof(summary) - 1 } }
+
+// One row per mask value; bits are listed in AlertFlags order (flow high, flow low, humidity,
+// temperature, pressure), the same order the old per-frame builder appended them.
+static const struct {
+    StrRef list;
+    StrRef summary;
+} ALERT_TABLE[ALERT_MASK_ALL + 1] = {
+    /*  0 */ ENTRY("[]", "None"),
+    /*  1 */ ENTRY("[\"HIGH_FLOW\"]", "High flow"),
+    /*  2 */ ENTRY("[\"LOW_FLOW\"]", "Low flow"),
+    /*  3 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\"]", "High flow, Low flow"),
+    /*  4 */ ENTRY("[\"HIGH_HUMIDITY\"]", "High humidity"),
+    /*  5 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_HUMIDITY\"]", "High flow, High humidity"),
+    /*  6 */ ENTRY("[\"LOW_FLOW\",\"HIGH_HUMIDITY\"]", "Low flow, High humidity"),
+    /*  7 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_HUMIDITY\"]", "High flow, Low flow, High humidity"),
+    /*  8 */ ENTRY("[\"HIGH_TEMP\"]", "High temperature"),
+    /*  9 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_TEMP\"]", "High flow, High temperature"),
+    /* 10 */ ENTRY("[\"LOW_FLOW\",\"HIGH_TEMP\"]", "Low flow, High temperature"),
+    /* 11 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_TEMP\"]", "High flow, Low flow, High temperature"),
+    /* 12 */ ENTRY("[\"HIGH_HUMIDITY\",\"HIGH_TEMP\"]", "High humidity, High temperature"),
+    /* 13 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\"]", "High flow, High humidity, High temperature"),
+    /* 14 */ ENTRY("[\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\"]", "Low flow, High humidity, High temperature"),
+    /* 15 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\"]", "High flow, Low flow, High humidity, High temperature"),
+    /* 16 */ ENTRY("[\"HIGH_PRESSURE\"]", "High pressure"),
+    /* 17 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_PRESSURE\"]", "High flow, High pressure"),
+    /* 18 */ ENTRY("[\"LOW_FLOW\",\"HIGH_PRESSURE\"]", "Low flow, High pressure"),
+    /* 19 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_PRESSURE\"]", "High flow, Low flow, High pressure"),
+    /* 20 */ ENTRY("[\"HIGH_HUMIDITY\",\"HIGH_PRESSURE\"]", "High humidity, High pressure"),
+    /* 21 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_PRESSURE\"]", "High flow, High humidity, High pressure"),
+    /* 22 */ ENTRY("[\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_PRESSURE\"]", "Low flow, High humidity, High pressure"),
+    /* 23 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_PRESSURE\"]", "High flow, Low flow, High humidity, High pressure"),
+    /* 24 */ ENTRY("[\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High temperature, High pressure"),
+    /* 25 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High flow, High temperature, High pressure"),
+    /* 26 */ ENTRY("[\"LOW_FLOW\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "Low flow, High temperature, High pressure"),
+    /* 27 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High flow, Low flow, High temperature, High pressure"),
+    /* 28 */ ENTRY("[\"HIGH_HUMIDITY\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High humidity, High temperature, High pressure"),
+    /* 29 */ ENTRY("[\"HIGH_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High flow, High humidity, High temperature, High pressure"),
+    /* 30 */ ENTRY("[\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "Low flow, High humidity, High temperature, High pressure"),
+    /* 31 */ ENTRY("[\"HIGH_FLOW\",\"LOW_FLOW\",\"HIGH_HUMIDITY\",\"HIGH_TEMP\",\"HIGH_PRESSURE\"]", "High flow, Low flow, High humidity, High temperature, High pressure"),
+};
+#undef ENTRY
+
+const char* alert_list_json(AlertFlags mask, size_t* len) {
+    unsigned m = (unsigned)mask & ALERT_MASK_ALL;
+    if (len) *len = ALERT_TABLE[m].list.len;
+    return ALERT_TABLE[m].list.s;
+}
+
+const char* alert_summary(AlertFlags mask, size_t* len) {
+    unsigned m = (unsigned)mask & ALERT_MASK_ALL;
+    if (len) *len = ALERT_TABLE[m].summary.len;
+    return ALERT_TABLE[m].summary.s;
+}
+
+#define PUT_LIT(p, lit) (memcpy((p), (lit), sizeof(lit) - 1), (p) += sizeof(lit) - 1)
+
+static char* put_u64(char* p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+char* fmt_fixed2(char* p, float v) {
+    double x = (double)v;
+    // NaN, infinities and very large values are rare; let printf handle those exactly
+    if (!(x > -1e15 && x < 1e15)) return p + sprintf(p, "%.2f", x);
+
+    // A float has 24 significant bits, so |x| * 100 is exact in a double. rint() then rounds
+    // half-to-even just like printf does on an exact tie (e.g. 0.125 -> "0.12").
+    uint64_t cents = (uint64_t)rint(fabs(x) * 100.0);
+    if (signbit(x)) *p++ = '-'; // printf keeps the sign even when the value rounds to 0.00
+    p = put_u64(p, cents / 100);
+    unsigned frac = (unsigned)(cents % 100);
+    *p++ = '.';
+    *p++ = (char)('0' + frac / 10);
+    *p++ = (char)('0' + frac % 10);
+    return p;
+}
+
+size_t json_format_current(const SensorData* d, char* out, size_t cap) {
+    if (cap < SSE_FRAME_MAX) return 0;
+    char* p = out;
+    size_t n;
+    const char* s;
+
+    PUT_LIT(p, "{ \"flow_lpm\": ");
+    p = fmt_fixed2(p, d->flow_lpm);
+    PUT_LIT(p, ", \"humidity_pct\": ");
+    p = fmt_fixed2(p, d->humidity_pct);
+    PUT_LIT(p, ", \"temperature_c\": ");
+    p = fmt_fixed2(p, d->temperature_c);
+    PUT_LIT(p, ", \"pressure_kpa\": ");
+    p = fmt_fixed2(p, d->pressure_kpa);
+    PUT_LIT(p, ", \"alerts\": ");
+    s = alert_list_json(d->alerts_mask, &n);
+    memcpy(p, s, n);
+    p += n;
+    if (d->conn == CONN_CONNECTED) PUT_LIT(p, ", \"connection\": \"CONNECTED\", \"via\": \"");
+    else PUT_LIT(p, ", \"connection\": \"DISCONNECTED\", \"via\": \"");
+    n = strnlen(d->via, sizeof(d->via));
+    memcpy(p, d->via, n);
+    p += n;
+    PUT_LIT(p, "\", \"seq\": ");
+    p = put_u64(p, d->last_seq);
+    PUT_LIT(p, ", \"alert_summary\": \"");
+    s = alert_summary(d->alerts_mask, &n);
+    memcpy(p, s, n);
+    p += n;
+    PUT_LIT(p, "\" }");
+    return (size_t)(p - out);
+}
+
+size_t sse_format_frame(const SensorData* d, char* out, size_t cap) {
+    if (cap < SSE_FRAME_MAX + 8) return 0;
+    char* p = out;
+    PUT_LIT(p, "data: ");
+    p += json_format_current(d, p, cap - 8);
+    PUT_LIT(p, "\n\n");
+    return (size_t)(p - out);
+}
+
+size_t sse_format_filtered(const SensorData* d, unsigned fields, char* out, size_t cap) {
+    if (cap < SSE_FILTERED_FRAME_MAX) return 0;
+    char* p = out;
+    size_t n;
+    const char* s;
+
+    PUT_LIT(p, "data: { \"sensor_id\": \"");
+    n = strnlen(d->sensor_id, sizeof(d->sensor_id));
+    memcpy(p, d->sensor_id, n);
+    p += n;
+    *p++ = '"';
+    if (fields & FIELD_FLOW) { PUT_LIT(p, ", \"flow_lpm\": "); p = fmt_fixed2(p, d->flow_lpm); }
+    if (fields & FIELD_HUMIDITY) { PUT_LIT(p, ", \"humidity_pct\": "); p = fmt_fixed2(p, d->humidity_pct); }
+    if (fields & FIELD_TEMPERATURE) { PUT_LIT(p, ", \"temperature_c\": "); p = fmt_fixed2(p, d->temperature_c); }
+    if (fields & FIELD_PRESSURE) { PUT_LIT(p, ", \"pressure_kpa\": "); p = fmt_fixed2(p, d->pressure_kpa); }
+    if (fields & FIELD_ALERTS) {
+        PUT_LIT(p, ", \"alerts\": ");
+        s = alert_list_json(d->alerts_mask, &n);
+        memcpy(p, s, n);
+        p += n;
+    }
+    if (fields & FIELD_CONNECTION) {
+        if (d->conn == CONN_CONNECTED) PUT_LIT(p, ", \"connection\": \"CONNECTED\", \"via\": \"");
+        else PUT_LIT(p, ", \"connection\": \"DISCONNECTED\", \"via\": \"");
+        n = strnlen(d->via, sizeof(d->via));
+        memcpy(p, d->via, n);
+        p += n;
+        *p++ = '"';
+    }
+    PUT_LIT(p, ", \"seq\": ");
+    p = put_u64(p, d->last_seq);
+    if (fields & FIELD_ALERTS) {
+        PUT_LIT(p, ", \"alert_summary\": \"");
+        s = alert_summary(d->alerts_mask, &n);
+        memcpy(p, s, n);
+        p += n;
+        *p++ = '"';
+    }
+    PUT_LIT(p, " }\n\n");
+    return (size_t)(p - out);
+}
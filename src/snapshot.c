@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "snapshot.h"
+#include "state.h"
+#include "history.h"
+#include "log.h"
+
+// Snapshot-on-shutdown / warm start.
+// Writing happens once after every thread has been joined, so nothing is racing the dump.
+// Loading maps the file read-only and copies the fixed-size sections straight into place,
+// which takes milliseconds even for a full history ring.
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// Write all bytes and fold them into the running checksum
+static int write_section(int fd, const void* data, size_t len, uint64_t* sum) {
+    const char* p = (const char*)data;
+    *sum = fnv1a(*sum, data, len);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int snapshot_write(SharedState* st, const char* path) {
+    int max = MAX_DEVICES * (st->nslices > 0 ? st->nslices : 1);
+    SensorData* devs = malloc(sizeof(SensorData) * (size_t)max);
+    RollingStats* stats = malloc(sizeof(RollingStats) * (size_t)max);
+    size_t hcap = st->history ? st->history->capacity : 0;
+    HistorySample* hist = malloc(sizeof(HistorySample) * (hcap ? hcap : 1));
+    if (!devs || !stats || !hist) {
+        free(devs); free(stats); free(hist);
+        return -1;
+    }
+
+    SensorData dash;
+    pthread_mutex_lock(&st->mu);
+    dash = st->data;
+    pthread_mutex_unlock(&st->mu);
+    int ndev = state_merged_devices(st, devs, stats, max);
+    size_t nhist = st->history ? history_copy(st->history, 0, hist, hcap, NULL) : 0;
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERR("snapshot: cannot create %s", tmp);
+        free(devs); free(stats); free(hist);
+        return -1;
+    }
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.header_size = sizeof(SnapshotHeader);
+    hdr.sensor_size = sizeof(SensorData);
+    hdr.stats_size = sizeof(RollingStats);
+    hdr.history_size = sizeof(HistorySample);
+    hdr.device_count = (uint32_t)ndev;
+    hdr.history_count = nhist;
+    hdr.written_ms = history_now_ms();
+
+    // Header first as a placeholder, then the sections, then the header again with the checksum
+    uint64_t sum = FNV_OFFSET;
+    uint64_t ignore = FNV_OFFSET;
+    int rc = write_section(fd, &hdr, sizeof(hdr), &ignore);
+    if (rc == 0) rc = write_section(fd, &dash, sizeof(dash), &sum);
+    if (rc == 0) rc = write_section(fd, devs, sizeof(SensorData) * (size_t)ndev, &sum);
+    if (rc == 0) rc = write_section(fd, stats, sizeof(RollingStats) * (size_t)ndev, &sum);
+    if (rc == 0) rc = write_section(fd, hist, sizeof(HistorySample) * nhist, &sum);
+    hdr.checksum = sum;
+    if (rc == 0 && pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) rc = -1;
+    if (rc == 0 && fsync(fd) != 0) rc = -1;
+    close(fd);
+    free(devs); free(stats); free(hist);
+
+    // rename() swaps the file atomically, so a crash mid-write never leaves a torn snapshot
+    if (rc != 0 || rename(tmp, path) != 0) {
+        LOG_ERR("snapshot: failed to write %s", path);
+        unlink(tmp);
+        return -1;
+    }
+    LOG_INFO("Snapshot written to %s (%d devices, %zu history samples)", path, ndev, nhist);
+    return 0;
+}
+
+static double mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+int snapshot_load(SharedState* st, const char* path) {
+    double t0 = mono_ms();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1; // first run: nothing to restore
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        LOG_WARN("snapshot: %s is too small, ignoring", path);
+        return -1;
+    }
+    size_t size = (size_t)sb.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid on its own
+    if (map == MAP_FAILED) {
+        LOG_WARN("snapshot: mmap of %s failed", path);
+        return -1;
+    }
+
+    const SnapshotHeader* hdr = (const SnapshotHeader*)map;
+    const unsigned char* body = (const unsigned char*)map + sizeof(SnapshotHeader);
+    size_t devs_bytes = (size_t)hdr->device_count * sizeof(SensorData);
+    size_t stats_bytes = (size_t)hdr->device_count * sizeof(RollingStats);
+    size_t expect = sizeof(SnapshotHeader) + sizeof(SensorData) + devs_bytes + stats_bytes;
+
+    const char* why = NULL;
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) why = "bad magic";
+    else if (hdr->version != SNAPSHOT_VERSION) why = "unsupported version";
+    else if (hdr->header_size != sizeof(SnapshotHeader) || hdr->sensor_size != sizeof(SensorData) ||
+             hdr->stats_size != sizeof(RollingStats) || hdr->history_size != sizeof(HistorySample)) why = "record layout mismatch";
+    else if (size < expect || hdr->history_count > (size - expect) / sizeof(HistorySample)) why = "truncated";
+    else if (size != expect + hdr->history_count * sizeof(HistorySample)) why = "trailing bytes";
+    else if (fnv1a(FNV_OFFSET, body, size - sizeof(SnapshotHeader)) != hdr->checksum) why = "checksum mismatch";
+    if (why) {
+        LOG_WARN("snapshot: ignoring %s (%s)", path, why);
+        munmap(map, size);
+        return -1;
+    }
+
+    // Copy out through memcpy so no unaligned struct access happens on strict platforms
+    SensorData dash;
+    memcpy(&dash, body, sizeof(dash));
+    dash.conn = CONN_DISCONNECTED; // stale until live ingest says otherwise
+
+    const unsigned char* p = body + sizeof(SensorData);
+    int ndev = (int)hdr->device_count;
+    SensorData* devs = malloc(devs_bytes ? devs_bytes : 1);
+    RollingStats* stats = malloc(stats_bytes ? stats_bytes : 1);
+    if (!devs || !stats) {
+        free(devs); free(stats);
+        munmap(map, size);
+        return -1;
+    }
+    memcpy(devs, p, devs_bytes);
+    memcpy(stats, p + devs_bytes, stats_bytes);
+    for (int i = 0; i < ndev; i++) devs[i].conn = CONN_DISCONNECTED;
+    // Each device goes back to the slice that owns it now (the slice count may have changed)
+    for (int i = 0; st->slices && i < ndev; i++) {
+        device_table_restore(&st->slices[state_slice_of(st, devs[i].sensor_id)], &devs[i], &stats[i], 1);
+    }
+    free(devs);
+    free(stats);
+
+    // History keeps only the newest records that fit the (possibly smaller) ring
+    if (st->history && hdr->history_count > 0) {
+        const unsigned char* hp = p + devs_bytes + stats_bytes;
+        size_t n = (size_t)hdr->history_count;
+        size_t keep = n < st->history->capacity ? n : st->history->capacity;
+        HistorySample* recs = malloc(keep * sizeof(HistorySample));
+        if (recs) {
+            memcpy(recs, hp + (n - keep) * sizeof(HistorySample), keep * sizeof(HistorySample));
+            history_append_records(st->history, recs, keep);
+            free(recs);
+        }
+    }
+
+    pthread_mutex_lock(&st->mu);
+    char via[sizeof(st->data.via)];
+    memcpy(via, st->data.via, sizeof(via)); // keep the mode label of this run
+    st->data = dash;
+    memcpy(st->data.via, via, sizeof(via));
+    pthread_mutex_unlock(&st->mu);
+
+    uint64_t nhist = hdr->history_count;
+    uint64_t age_ms = history_now_ms() - hdr->written_ms;
+    munmap(map, size);
+    LOG_INFO("Warm start from %s in %.2f ms: %d devices, %llu history samples (written %llu ms ago)", path,
+             mono_ms() - t0, ndev, (unsigned long long)nhist, (unsigned long long)age_ms);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <string.h>
+#include "spsc.h"
+
+// Single-producer/single-consumer ring used between ingest stages.
+// head is only written by the consumer and tail only by the producer, so a
+// release store on one side paired with an acquire load on the other is enough
+// to hand a slot across threads without any lock.
+
+int spsc_init(SpscRing* r, size_t capacity, size_t slot_size) {
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1; // power of two keeps the index wrap a cheap mask
+    r->slots = calloc(cap, slot_size);
+    if (!r->slots) return -1;
+    r->capacity = cap;
+    r->slot_size = slot_size;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return 0;
+}
+
+void spsc_free(SpscRing* r) {
+    free(r->slots);
+    r->slots = NULL;
+    r->capacity = 0;
+}
+
+void* spsc_acquire_write(SpscRing* r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head >= r->capacity) return NULL; // full
+    return r->slots + (tail & (r->capacity - 1)) * r->slot_size;
+}
+
+void spsc_commit_write(SpscRing* r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+void* spsc_acquire_read(SpscRing* r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail) return NULL; // empty
+    return r->slots + (head & (r->capacity - 1)) * r->slot_size;
+}
+
+void spsc_release_read(SpscRing* r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+size_t spsc_depth(SpscRing* r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    return tail - head;
+}
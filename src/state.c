@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+#include "history.h"
+#include "uplink.h"
+#include "notify.h"
+#include "subs.h"
+
+// Central place where ingest threads write into SharedState.
+// Keeping the writes here means the HTTP thread only has to understand one update rule:
+// st->data always holds the newest sample and last_seq counts how many samples were applied.
+
+// Allocate the per-device slices (one per ingest shard; a single one for TCP/SIM).
+int state_init_slices(SharedState* st, int nslices) {
+    st->slices = calloc((size_t)nslices, sizeof(DeviceTable));
+    if (!st->slices) return -1;
+    for (int i = 0; i < nslices; i++) device_table_init(&st->slices[i]);
+    st->nslices = nslices;
+    return 0;
+}
+
+int state_slice_of(SharedState* st, const char* sensor_id) {
+    if (st->nslices <= 1) return 0;
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)sensor_id; *p; p++) h = (h ^ *p) * 16777619u;
+    return (int)(h % (uint32_t)st->nslices);
+}
+
+int state_init_history(SharedState* st, size_t capacity) {
+    st->history = malloc(sizeof(History));
+    if (!st->history) return -1;
+    if (history_init(st->history, capacity) != 0) {
+        free(st->history);
+        st->history = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int state_stopping(SharedState* st) {
+    return atomic_load(&st->stop);
+}
+
+// Update connection fields together (with locking).
+// Also bumps last_seq so the HTTP thread knows data changed and should push an update.
+void state_set_connection(SharedState* st, ConnectionStatus status, const char* via) {
+    pthread_mutex_lock(&st->mu);
+    st->data.conn = status;
+    if (via) snprintf(st->data.via, sizeof(st->data.via), "%s", via);
+    st->data.last_seq++;
+    pthread_mutex_unlock(&st->mu);
+}
+
+// Apply a whole batch with a single lock per structure: each sample already carries the
+// carried-forward optional fields, so the dashboard only needs the newest one.
+void state_publish_batch(SharedState* st, const SensorData* samples, int count) {
+    if (count <= 0) return;
+    // The device table knows each device's previous mask, so alert edges are found while applying.
+    // Runs of samples owned by the same slice go in under one lock (a connection's lines arrive
+    // together, so runs are usually long).
+    AlertTransition tr[NOTIFY_TRANSITIONS_PER_BATCH];
+    int ntr = 0;
+    for (int start = 0; st->slices && start < count;) {
+        int slice = state_slice_of(st, samples[start].sensor_id);
+        int end = start + 1;
+        while (end < count && state_slice_of(st, samples[end].sensor_id) == slice) end++;
+        // Edges past the array are still counted; notify_publish reports them as dropped
+        int room = ntr < NOTIFY_TRANSITIONS_PER_BATCH ? NOTIFY_TRANSITIONS_PER_BATCH - ntr : 0;
+        AlertTransition* out = (st->notify || st->subs) ? tr + (room ? ntr : 0) : NULL;
+        int found = device_table_apply(&st->slices[slice], samples + start, end - start, out, room);
+        for (int k = 0; k < found && k < room; k++) out[k].index += start;
+        ntr += found;
+        start = end;
+    }
+    // The history stamps under its own lock so appends stay ordered; everyone else shares that stamp
+    uint64_t now = st->history ? history_append_batch(st->history, samples, count) : history_now_ms();
+    if (st->uplink) uplink_enqueue(st->uplink, samples, count, now); // edge gateway: forward upstream
+    if (ntr > 0 && st->notify) notify_publish(st->notify, samples, tr, ntr, now); // webhook queue
+    if (st->subs) subs_publish(st->subs, samples, count, tr, ntr);     // filtered /events streams
+
+    pthread_mutex_lock(&st->mu);
+    uint64_t seq = st->data.last_seq;
+    st->data = samples[count - 1];
+    st->data.last_seq = seq + (uint64_t)count;
+    pthread_mutex_unlock(&st->mu);
+}
+
+void state_device_conn_open(SharedState* st, const char* sensor_id) {
+    if (!st->slices || !sensor_id[0]) return;
+    device_table_conn_open(&st->slices[state_slice_of(st, sensor_id)], sensor_id);
+}
+
+void state_device_conn_release(SharedState* st, const char* sensor_id, int closed) {
+    if (!st->slices || !sensor_id[0]) return;
+    DeviceTable* t = &st->slices[state_slice_of(st, sensor_id)];
+    if (device_table_conn_close(t, sensor_id, closed) && st->subs) subs_device_changed(st->subs, sensor_id);
+}
+
+int state_device(SharedState* st, const char* sensor_id, SensorData* out) {
+    if (!st->slices) return -1;
+    return device_table_get(&st->slices[state_slice_of(st, sensor_id)], sensor_id, out);
+}
+
+int state_merged_devices(SharedState* st, SensorData* out, RollingStats* stats, int max) {
+    int n = 0;
+    for (int i = 0; i < st->nslices && n < max; i++) {
+        n += device_table_copy(&st->slices[i], out + n, stats ? stats + n : NULL, max - n);
+    }
+    return n;
+}
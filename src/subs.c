@@ -0,0 +1,521 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "subs.h"
+#include "serialize.h"
+#include "state.h"
+#include "devices.h"
+#include "history.h"
+#include "notify.h"
+#include "log.h"
+
+// Subscription hub for filtered SSE streams.
+// One hub thread replaces the per-client polling loop for filtered clients. Ingest tells it
+// which devices changed (a hashed set of ids, so each one is looked up once per pass however
+// often it updated) and which alert edges it saw; the hub finds the filter groups that care
+// through the sensor index and serializes once per group. Sockets are non-blocking; a
+// subscriber that cannot take a whole frame is dropped rather than allowed to stall everyone else.
+
+typedef struct Subscriber {
+    int fd;
+    int primed;                   // has received the current state of its sensors
+    struct Subscriber* next;
+} Subscriber;
+
+typedef struct FilterGroup {
+    SubFilter f;
+    Subscriber* subs;
+    int needs_prime;
+    uint64_t last_send_ms;
+    struct FilterGroup* next;
+} FilterGroup;
+
+typedef struct {
+    char sensor_id[32];
+    FilterGroup** groups;
+    int ngroups;
+} IndexEntry;
+
+struct SubHub {
+    SharedState* st;
+    pthread_mutex_t mu;           // groups, index and sockets (hub thread, subs_add, stats)
+    FilterGroup* groups;
+    int ngroups;
+    atomic_int nsubs;             // also read without mu: nobody subscribed, nothing to note
+
+    // sensor -> groups index (sorted by sensor_id) plus the groups that want every sensor
+    IndexEntry* index;
+    int nindex;
+    FilterGroup** wildcard;
+    int nwild;
+    int index_dirty;
+
+    // Ingest -> hub, guarded by pmu (never held while writing to a socket)
+    pthread_mutex_t pmu;
+    pthread_cond_t cv;            // signalled when something is published or subscribes
+    char (*dirty)[32];            // ids updated since the last pass, each once
+    int* dirty_slot;              // where each of them sits in slots
+    int ndirty;
+    int cap_dirty;
+    int* slots;                   // open addressing over dirty, -1 = free (power of two)
+    int nslots;
+    int all_dirty;                // more distinct ids than cap_dirty: send every device
+    SensorData* alerts;           // alert edges in order, with the device's seq after each
+    int nalerts;
+    uint64_t alerts_dropped;
+
+    // Hub-side copies of the above, taken at the start of a pass
+    char (*work_ids)[32];
+    SensorData* work_alerts;
+    SensorData* devs;             // merged device view (priming wildcard groups, all_dirty)
+    int max_devs;
+
+    uint64_t frames_serialized;
+    uint64_t frames_sent;
+    uint64_t dropped;
+};
+
+// ---- filter parsing -------------------------------------------------------
+
+static size_t url_decode(const char* src, size_t len, char* out, size_t outsz) {
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < outsz - 1; i++) {
+        char c = src[i];
+        if (c == '+') c = ' ';
+        else if (c == '%' && i + 2 < len && isxdigit((unsigned char)src[i + 1]) && isxdigit((unsigned char)src[i + 2])) {
+            char hex[3] = { src[i + 1], src[i + 2], 0 };
+            c = (char)strtol(hex, NULL, 16);
+            i += 2;
+        }
+        out[n++] = c;
+    }
+    out[n] = 0;
+    return n;
+}
+
+static unsigned field_bit(const char* name) {
+    static const struct { const char* name; unsigned bit; } names[] = {
+        { "flow_lpm", FIELD_FLOW }, { "flow", FIELD_FLOW },
+        { "humidity_pct", FIELD_HUMIDITY }, { "humidity", FIELD_HUMIDITY },
+        { "temperature_c", FIELD_TEMPERATURE }, { "temperature", FIELD_TEMPERATURE },
+        { "pressure_kpa", FIELD_PRESSURE }, { "pressure", FIELD_PRESSURE },
+        { "alerts", FIELD_ALERTS },
+        { "connection", FIELD_CONNECTION }, { "via", FIELD_CONNECTION },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(names[i].name, name) == 0) return names[i].bit;
+    }
+    return 0;
+}
+
+static int cmp_sensor(const void* a, const void* b) {
+    return strcmp((const char*)a, (const char*)b);
+}
+
+// Walk a comma-separated, url-encoded list and call fn for each non-empty item
+static int for_each_item(const char* v, size_t vlen, int (*fn)(const char* item, SubFilter* f), SubFilter* f) {
+    char decoded[512];
+    url_decode(v, vlen, decoded, sizeof(decoded));
+    char* save = NULL;
+    for (char* tok = strtok_r(decoded, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (*tok && fn(tok, f) != 0) return -1;
+    }
+    return 0;
+}
+
+static int add_sensor(const char* id, SubFilter* f) {
+    for (int i = 0; i < f->nsensors; i++) {
+        if (strcmp(f->sensors[i], id) == 0) return 0; // duplicate
+    }
+    if (f->nsensors == SUB_MAX_SENSORS) return -1;
+    snprintf(f->sensors[f->nsensors++], sizeof(f->sensors[0]), "%s", id);
+    return 0;
+}
+
+static int add_field(const char* name, SubFilter* f) {
+    unsigned bit = field_bit(name);
+    if (!bit) return -1;
+    f->fields |= bit;
+    return 0;
+}
+
+int subs_parse_filter(const char* query, SubFilter* out) {
+    memset(out, 0, sizeof(*out)); // zeroed so equal filters compare equal byte for byte
+    int filtered = 0;
+    const char* p = query ? query : "";
+    while (*p) {
+        const char* amp = strchr(p, '&');
+        size_t len = amp ? (size_t)(amp - p) : strlen(p);
+        const char* eq = memchr(p, '=', len);
+        size_t klen = eq ? (size_t)(eq - p) : len;
+        const char* v = eq ? eq + 1 : p + len;
+        size_t vlen = (size_t)(p + len - v);
+
+        if (klen == 7 && strncmp(p, "sensors", 7) == 0) {
+            if (for_each_item(v, vlen, add_sensor, out) != 0) return -1;
+            filtered = 1;
+        } else if (klen == 6 && strncmp(p, "fields", 6) == 0) {
+            if (for_each_item(v, vlen, add_field, out) != 0) return -1;
+            filtered = 1;
+        } else if (klen == 11 && strncmp(p, "alerts_only", 11) == 0) {
+            out->alerts_only = (vlen == 0 || strncmp(v, "1", vlen) == 0 || strncasecmp(v, "true", vlen) == 0);
+            filtered = 1;
+        }
+        p += len;
+        if (*p == '&') p++;
+    }
+    if (!out->fields) out->fields = out->alerts_only ? FIELD_ALERTS : FIELD_ALL;
+    qsort(out->sensors, (size_t)out->nsensors, sizeof(out->sensors[0]), cmp_sensor);
+    return filtered;
+}
+
+// ---- hub ------------------------------------------------------------------
+
+SubHub* subs_create(SharedState* st) {
+    SubHub* hub = calloc(1, sizeof(SubHub));
+    if (!hub) return NULL;
+    hub->st = st;
+    pthread_mutex_init(&hub->mu, NULL);
+    pthread_mutex_init(&hub->pmu, NULL);
+    pthread_cond_init(&hub->cv, NULL);
+    hub->max_devs = MAX_DEVICES * (st->nslices > 0 ? st->nslices : 1);
+    hub->cap_dirty = hub->max_devs;
+    hub->nslots = 1;
+    while (hub->nslots < 2 * hub->cap_dirty) hub->nslots *= 2;
+    hub->dirty = malloc(sizeof(hub->dirty[0]) * (size_t)hub->cap_dirty);
+    hub->dirty_slot = malloc(sizeof(int) * (size_t)hub->cap_dirty);
+    hub->slots = malloc(sizeof(int) * (size_t)hub->nslots);
+    hub->alerts = malloc(sizeof(SensorData) * SUB_ALERT_QUEUE);
+    hub->work_ids = malloc(sizeof(hub->work_ids[0]) * (size_t)hub->cap_dirty);
+    hub->work_alerts = malloc(sizeof(SensorData) * SUB_ALERT_QUEUE);
+    hub->devs = malloc(sizeof(SensorData) * (size_t)hub->max_devs);
+    if (!hub->dirty || !hub->dirty_slot || !hub->slots || !hub->alerts || !hub->work_ids ||
+        !hub->work_alerts || !hub->devs) {
+        subs_destroy(hub);
+        return NULL;
+    }
+    for (int i = 0; i < hub->nslots; i++) hub->slots[i] = -1;
+    return hub;
+}
+
+static void free_index(SubHub* hub) {
+    for (int i = 0; i < hub->nindex; i++) free(hub->index[i].groups);
+    free(hub->index);
+    free(hub->wildcard);
+    hub->index = NULL;
+    hub->wildcard = NULL;
+    hub->nindex = hub->nwild = 0;
+}
+
+void subs_destroy(SubHub* hub) {
+    if (!hub) return;
+    FilterGroup* g = hub->groups;
+    while (g) {
+        Subscriber* s = g->subs;
+        while (s) {
+            Subscriber* next = s->next;
+            if (s->fd >= 0) close(s->fd);
+            free(s);
+            s = next;
+        }
+        FilterGroup* next = g->next;
+        free(g);
+        g = next;
+    }
+    free_index(hub);
+    pthread_mutex_destroy(&hub->mu);
+    pthread_mutex_destroy(&hub->pmu);
+    pthread_cond_destroy(&hub->cv);
+    free(hub->dirty);
+    free(hub->dirty_slot);
+    free(hub->slots);
+    free(hub->alerts);
+    free(hub->work_ids);
+    free(hub->work_alerts);
+    free(hub->devs);
+    free(hub);
+}
+
+int subs_add(SubHub* hub, int fd, const SubFilter* f) {
+    Subscriber* s = calloc(1, sizeof(Subscriber));
+    if (!s) return -1;
+    s->fd = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    pthread_mutex_lock(&hub->mu);
+    FilterGroup* g = hub->groups;
+    while (g && memcmp(&g->f, f, sizeof(*f)) != 0) g = g->next;
+    if (!g) {
+        g = calloc(1, sizeof(FilterGroup));
+        if (!g) {
+            pthread_mutex_unlock(&hub->mu);
+            free(s);
+            return -1;
+        }
+        g->f = *f;
+        g->last_send_ms = history_now_ms();
+        g->next = hub->groups;
+        hub->groups = g;
+        hub->ngroups++;
+        hub->index_dirty = 1;
+    }
+    s->next = g->subs;
+    g->subs = s;
+    g->needs_prime = 1;
+    atomic_fetch_add(&hub->nsubs, 1);
+    pthread_mutex_unlock(&hub->mu);
+
+    // Wake the hub so the newcomer is primed now rather than at the next idle pass
+    pthread_mutex_lock(&hub->pmu);
+    pthread_cond_signal(&hub->cv);
+    pthread_mutex_unlock(&hub->pmu);
+    return 0;
+}
+
+static int cmp_entry(const void* a, const void* b) {
+    return strcmp(((const IndexEntry*)a)->sensor_id, ((const IndexEntry*)b)->sensor_id);
+}
+
+// Rebuild sensor -> groups from scratch; only happens when a filter group appears or goes away
+static void rebuild_index(SubHub* hub) {
+    free_index(hub);
+    int total = 0;
+    for (FilterGroup* g = hub->groups; g; g = g->next) total += g->f.nsensors;
+    hub->index = calloc((size_t)(total ? total : 1), sizeof(IndexEntry));
+    hub->wildcard = calloc((size_t)(hub->ngroups ? hub->ngroups : 1), sizeof(FilterGroup*));
+
+    for (FilterGroup* g = hub->groups; g; g = g->next) {
+        if (g->f.nsensors == 0) {
+            hub->wildcard[hub->nwild++] = g;
+            continue;
+        }
+        for (int k = 0; k < g->f.nsensors; k++) {
+            IndexEntry* e = NULL;
+            for (int i = 0; i < hub->nindex; i++) {
+                if (strcmp(hub->index[i].sensor_id, g->f.sensors[k]) == 0) { e = &hub->index[i]; break; }
+            }
+            if (!e) {
+                e = &hub->index[hub->nindex++];
+                memcpy(e->sensor_id, g->f.sensors[k], sizeof(e->sensor_id));
+                e->groups = calloc((size_t)hub->ngroups, sizeof(FilterGroup*));
+            }
+            e->groups[e->ngroups++] = g;
+        }
+    }
+    qsort(hub->index, (size_t)hub->nindex, sizeof(IndexEntry), cmp_entry);
+    hub->index_dirty = 0;
+}
+
+// ---- ingest side ----------------------------------------------------------
+
+static uint32_t hash_id(const char* id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)id; *p; p++) h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+// Add id to the dirty set (caller holds pmu)
+static void mark_dirty(SubHub* hub, const char* id) {
+    if (hub->all_dirty) return;
+    uint32_t mask = (uint32_t)hub->nslots - 1;
+    uint32_t slot = hash_id(id) & mask;
+    for (int k; (k = hub->slots[slot]) >= 0; slot = (slot + 1) & mask) {
+        if (strcmp(hub->dirty[k], id) == 0) return;
+    }
+    if (hub->ndirty == hub->cap_dirty) { hub->all_dirty = 1; return; }
+    hub->slots[slot] = hub->ndirty;
+    hub->dirty_slot[hub->ndirty] = (int)slot;
+    snprintf(hub->dirty[hub->ndirty++], sizeof(hub->dirty[0]), "%s", id);
+}
+
+void subs_publish(SubHub* hub, const SensorData* samples, int count, const AlertTransition* tr, int ntr) {
+    if (atomic_load(&hub->nsubs) == 0) return;
+    int kept = ntr < NOTIFY_TRANSITIONS_PER_BATCH ? ntr : NOTIFY_TRANSITIONS_PER_BATCH;
+    pthread_mutex_lock(&hub->pmu);
+    for (int i = 0; i < count; i++) {
+        // A connection's lines arrive together: skip the lookup for repeats of the same id
+        if (i == 0 || strcmp(samples[i].sensor_id, samples[i - 1].sensor_id) != 0) mark_dirty(hub, samples[i].sensor_id);
+    }
+    int lost = ntr - kept;
+    for (int i = 0; i < kept; i++) {
+        if (hub->nalerts == SUB_ALERT_QUEUE) { lost++; continue; }
+        SensorData* a = &hub->alerts[hub->nalerts++];
+        *a = samples[tr[i].index];
+        a->last_seq = tr[i].seq;
+    }
+    hub->alerts_dropped += (uint64_t)lost;
+    pthread_cond_signal(&hub->cv);
+    pthread_mutex_unlock(&hub->pmu);
+}
+
+void subs_device_changed(SubHub* hub, const char* sensor_id) {
+    if (atomic_load(&hub->nsubs) == 0) return;
+    pthread_mutex_lock(&hub->pmu);
+    mark_dirty(hub, sensor_id);
+    pthread_cond_signal(&hub->cv);
+    pthread_mutex_unlock(&hub->pmu);
+}
+
+// ---- hub side -------------------------------------------------------------
+
+// A frame either goes out whole or the subscriber is dropped (a torn frame would corrupt the stream)
+static void send_sub(SubHub* hub, Subscriber* s, const char* buf, size_t len) {
+    if (s->fd < 0) return;
+    ssize_t n = write(s->fd, buf, len);
+    if (n == (ssize_t)len) {
+        hub->frames_sent++;
+        return;
+    }
+    close(s->fd);
+    s->fd = -1;
+    hub->dropped++;
+}
+
+// Serialize once for the group; primed selects subscribers that are already streaming (updates)
+// or the ones still waiting for the current state (priming)
+static void send_group(SubHub* hub, FilterGroup* g, const SensorData* d, int primed, uint64_t now) {
+    char frame[SSE_FILTERED_FRAME_MAX];
+    size_t len = sse_format_filtered(d, g->f.fields, frame, sizeof(frame));
+    hub->frames_serialized++;
+    for (Subscriber* s = g->subs; s; s = s->next) {
+        if (s->primed == primed) send_sub(hub, s, frame, len);
+    }
+    g->last_send_ms = now;
+}
+
+// Send d to every group that wants its sensor: plain groups for updates, alerts_only groups for edges
+static void fan_out(SubHub* hub, const SensorData* d, int alerts_only, uint64_t now) {
+    IndexEntry key;
+    memcpy(key.sensor_id, d->sensor_id, sizeof(key.sensor_id));
+    IndexEntry* e = hub->nindex ? bsearch(&key, hub->index, (size_t)hub->nindex, sizeof(IndexEntry), cmp_entry) : NULL;
+    for (int k = 0; e && k < e->ngroups; k++) {
+        if (e->groups[k]->f.alerts_only == alerts_only) send_group(hub, e->groups[k], d, 1, now);
+    }
+    for (int k = 0; k < hub->nwild; k++) {
+        if (hub->wildcard[k]->f.alerts_only == alerts_only) send_group(hub, hub->wildcard[k], d, 1, now);
+    }
+}
+
+// New subscribers get the current state of their sensors once
+static void prime(SubHub* hub, uint64_t now) {
+    int n = -1; // merged view, copied only if a wildcard group needs it
+    for (FilterGroup* g = hub->groups; g; g = g->next) {
+        if (!g->needs_prime) continue;
+        if (g->f.nsensors > 0) {
+            for (int k = 0; k < g->f.nsensors; k++) {
+                SensorData d;
+                if (state_device(hub->st, g->f.sensors[k], &d) == 0) send_group(hub, g, &d, 0, now);
+            }
+            continue;
+        }
+        if (n < 0) n = state_merged_devices(hub->st, hub->devs, NULL, hub->max_devs);
+        for (int i = 0; i < n; i++) send_group(hub, g, &hub->devs[i], 0, now);
+    }
+}
+
+// Drop closed subscribers and empty groups; everyone left has now been primed
+static void prune(SubHub* hub) {
+    FilterGroup** gp = &hub->groups;
+    while (*gp) {
+        FilterGroup* g = *gp;
+        Subscriber** sp = &g->subs;
+        while (*sp) {
+            Subscriber* s = *sp;
+            if (s->fd < 0) {
+                *sp = s->next;
+                free(s);
+                atomic_fetch_sub(&hub->nsubs, 1);
+            } else {
+                s->primed = 1;
+                sp = &s->next;
+            }
+        }
+        g->needs_prime = 0;
+        if (!g->subs) {
+            *gp = g->next;
+            free(g);
+            hub->ngroups--;
+            hub->index_dirty = 1;
+        } else {
+            gp = &g->next;
+        }
+    }
+}
+
+void subs_tick(SubHub* hub) {
+    pthread_mutex_lock(&hub->mu);
+    if (hub->index_dirty) rebuild_index(hub);
+    uint64_t now = history_now_ms();
+
+    // Take what ingest published since the previous pass and let it carry on
+    pthread_mutex_lock(&hub->pmu);
+    int nids = hub->ndirty;
+    int nalerts = hub->nalerts;
+    int all = hub->all_dirty;
+    memcpy(hub->work_ids, hub->dirty, sizeof(hub->dirty[0]) * (size_t)nids);
+    memcpy(hub->work_alerts, hub->alerts, sizeof(SensorData) * (size_t)nalerts);
+    for (int i = 0; i < nids; i++) hub->slots[hub->dirty_slot[i]] = -1;
+    hub->ndirty = hub->nalerts = hub->all_dirty = 0;
+    pthread_mutex_unlock(&hub->pmu);
+
+    if (hub->ngroups > 0) {
+        if (all) {
+            int n = state_merged_devices(hub->st, hub->devs, NULL, hub->max_devs);
+            for (int i = 0; i < n; i++) fan_out(hub, &hub->devs[i], 0, now);
+        } else {
+            for (int i = 0; i < nids; i++) {
+                SensorData d;
+                if (state_device(hub->st, hub->work_ids[i], &d) == 0) fan_out(hub, &d, 0, now);
+            }
+        }
+        for (int i = 0; i < nalerts; i++) fan_out(hub, &hub->work_alerts[i], 1, now);
+        prime(hub, now);
+    }
+
+    // Idle groups get a comment frame, which also flushes out clients that went away
+    static const char keepalive[] = ": keepalive\n\n";
+    for (FilterGroup* g = hub->groups; g; g = g->next) {
+        if (now - g->last_send_ms < SUB_KEEPALIVE_MS) continue;
+        for (Subscriber* s = g->subs; s; s = s->next) send_sub(hub, s, keepalive, sizeof(keepalive) - 1);
+        g->last_send_ms = now;
+    }
+    prune(hub);
+    pthread_mutex_unlock(&hub->mu);
+}
+
+void* subs_thread(void* arg) {
+    SubHub* hub = (SubHub*)arg;
+    while (!state_stopping(hub->st)) {
+        pthread_mutex_lock(&hub->pmu);
+        if (hub->ndirty == 0 && hub->nalerts == 0 && !hub->all_dirty) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += SUB_IDLE_MS * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&hub->cv, &hub->pmu, &ts);
+        }
+        pthread_mutex_unlock(&hub->pmu);
+        subs_tick(hub);
+    }
+    return NULL;
+}
+
+int subs_stats_json(SubHub* hub, char* out, size_t outsz) {
+    pthread_mutex_lock(&hub->pmu);
+    uint64_t alerts_dropped = hub->alerts_dropped;
+    pthread_mutex_unlock(&hub->pmu);
+    pthread_mutex_lock(&hub->mu);
+    int n = snprintf(out, outsz,
+        "{ \"groups\": %d, \"subscribers\": %d, \"indexed_sensors\": %d, \"frames_serialized\": %llu, \"frames_sent\": %llu, "
+        "\"dropped\": %llu, \"alerts_dropped\": %llu }",
+        hub->ngroups, atomic_load(&hub->nsubs), hub->nindex, (unsigned long long)hub->frames_serialized,
+        (unsigned long long)hub->frames_sent, (unsigned long long)hub->dropped, (unsigned long long)alerts_dropped);
+    pthread_mutex_unlock(&hub->mu);
+    return n;
+}
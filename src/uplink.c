@@ -0,0 +1,987 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include "uplink.h"
+#include "state.h"
+#include "json.h"
+#include "history.h"
+#include "log.h"
+
+// Gateway federation (see uplink.h for the wire format).
+// The edge side is one sender thread fed by a mutex-guarded sample queue; the ingest path
+// only copies samples into that queue. The aggregator side has no thread of its own: the
+// listen-mode shard that accepted an uplink connection decodes its batches in its poll loop.
+
+#define SPILL_RECORD_HDR 8           // u32 count, u32 payload len
+#define STALL_TIMEOUT_MS 10000       // window full and no ack for this long: reconnect
+#define DRAIN_TIMEOUT_MS 2000        // how long shutdown waits for the aggregator to ack
+#define SAMPLE_MAX_BYTES 53          // id, flags, ts delta and 4 field deltas as varints
+#define BITS_FLAG 0x80               // flags bit: readings follow as float32 bit-pattern deltas
+
+// ---------- little-endian + varint helpers ----------
+
+static void put_le32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_le64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_le32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint64_t get_le64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static unsigned char* put_varint(unsigned char* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static int get_varint(const unsigned char** pp, const unsigned char* end, uint64_t* out) {
+    const unsigned char* p = *pp;
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) return -1;
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *pp = p;
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// ---------- codec ----------
+
+// Most readings are exact hundredths (devices send two decimals), which delta-code into a
+// byte or two. A sample with any other reading (45.004, NaN, -0.0, ...) sends all four as deltas
+// of their float32 bit patterns instead. Both ways decode to the very same float.
+static int exact_cents(float v, int64_t* out) {
+    if (!isfinite(v)) return -1;
+    double c = rint((double)v * 100.0);
+    if (fabs(c) > 9.0e15) return -1;
+    int64_t cents = (int64_t)c;
+    float back = (float)((double)cents / 100.0); // exactly what the decoder computes
+    if (memcmp(&back, &v, sizeof(v)) != 0) return -1;
+    *out = cents;
+    return 0;
+}
+
+static uint32_t float_bits(float v) {
+    uint32_t b;
+    memcpy(&b, &v, sizeof(b));
+    return b;
+}
+
+// Per-sensor previous values, kept in both forms so either kind of sample can follow either kind.
+// Encoder and decoder update them from the same floats, so they stay in step.
+typedef struct {
+    int64_t cents[4];
+    uint32_t bits[4];
+} PrevReadings;
+
+static void prev_update(PrevReadings* pr, const float v[4]) {
+    for (int k = 0; k < 4; k++) {
+        int64_t c;
+        if (exact_cents(v[k], &c) == 0) pr->cents[k] = c;
+        pr->bits[k] = float_bits(v[k]);
+    }
+}
+
+size_t uplink_encode(const UplinkSample* in, int n, unsigned char* out, size_t cap, int* consumed) {
+    const char* ids[255];
+    unsigned char idx[UPLINK_BATCH_MAX];
+    int nids = 0;
+    int take = 0;
+    if (n > UPLINK_BATCH_MAX) n = UPLINK_BATCH_MAX;
+
+    // Pass 1: build the id table (a batch stops at the 256th distinct sensor)
+    for (; take < n; take++) {
+        int k = -1;
+        for (int j = 0; j < nids; j++) {
+            if (strcmp(ids[j], in[take].s.sensor_id) == 0) { k = j; break; }
+        }
+        if (k < 0) {
+            if (nids == 255) break;
+            ids[nids] = in[take].s.sensor_id;
+            k = nids++;
+        }
+        idx[take] = (unsigned char)k;
+    }
+    *consumed = take;
+    if (take == 0) return 0;
+    if (cap < 32 + (size_t)nids * 33 + (size_t)take * SAMPLE_MAX_BYTES) return 0;
+
+    // Pass 2: header, id table, then one delta-coded record per sample
+    unsigned char* p = out;
+    p = put_varint(p, (uint64_t)take);
+    p = put_varint(p, (uint64_t)nids);
+    for (int j = 0; j < nids; j++) {
+        size_t len = strnlen(ids[j], sizeof(in[0].s.sensor_id) - 1);
+        *p++ = (unsigned char)len;
+        memcpy(p, ids[j], len);
+        p += len;
+    }
+    p = put_varint(p, in[0].ts_ms);
+
+    PrevReadings prev[255];
+    memset(prev, 0, sizeof(prev));
+    uint64_t prev_ts = in[0].ts_ms;
+    for (int i = 0; i < take; i++) {
+        const SensorData* s = &in[i].s;
+        const float v[4] = { s->flow_lpm, s->humidity_pct, s->temperature_c, s->pressure_kpa };
+        PrevReadings* pr = &prev[idx[i]];
+        int64_t c[4];
+        int bits = 0;
+        for (int k = 0; k < 4; k++) {
+            if (exact_cents(v[k], &c[k]) != 0) bits = 1;
+        }
+
+        unsigned flags = ((unsigned)s->alerts_mask & 0x1F) | (s->flowing ? 0x20 : 0) |
+                         (s->conn == CONN_CONNECTED ? 0x40 : 0) | (bits ? BITS_FLAG : 0);
+        p = put_varint(p, idx[i]);
+        *p++ = (unsigned char)flags;
+        p = put_varint(p, zigzag((int64_t)(in[i].ts_ms - prev_ts)));
+        prev_ts = in[i].ts_ms;
+
+        for (int k = 0; k < 4; k++) {
+            if (bits) p = put_varint(p, zigzag((int32_t)(float_bits(v[k]) - pr->bits[k])));
+            else p = put_varint(p, zigzag(c[k] - pr->cents[k]));
+        }
+        prev_update(pr, v);
+    }
+    return (size_t)(p - out);
+}
+
+int uplink_decode(const unsigned char* in, size_t len, UplinkSample* out, int max) {
+    const unsigned char* p = in;
+    const unsigned char* end = in + len;
+    uint64_t count, nids, ts;
+    if (get_varint(&p, end, &count) != 0 || count > (uint64_t)max) return -1;
+    if (get_varint(&p, end, &nids) != 0 || nids > 255) return -1;
+
+    char ids[255][32];
+    for (uint64_t j = 0; j < nids; j++) {
+        if (p == end) return -1;
+        size_t l = *p++;
+        if (l > 31 || (size_t)(end - p) < l) return -1;
+        memcpy(ids[j], p, l);
+        ids[j][l] = 0;
+        if (!sensor_id_valid(ids[j])) return -1;
+        p += l;
+    }
+    if (get_varint(&p, end, &ts) != 0) return -1;
+
+    PrevReadings prev[255];
+    memset(prev, 0, sizeof(prev));
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t id, dts;
+        if (get_varint(&p, end, &id) != 0 || id >= nids || p == end) return -1;
+        unsigned flags = *p++;
+        if (get_varint(&p, end, &dts) != 0) return -1;
+        ts += (uint64_t)unzigzag(dts);
+
+        UplinkSample* u = &out[i];
+        memset(u, 0, sizeof(*u));
+        u->ts_ms = ts;
+        SensorData* s = &u->s;
+        PrevReadings* pr = &prev[id];
+        float v[4];
+        for (int k = 0; k < 4; k++) {
+            uint64_t d;
+            if (get_varint(&p, end, &d) != 0) return -1;
+            if (flags & BITS_FLAG) {
+                uint32_t b = pr->bits[k] + (uint32_t)unzigzag(d);
+                memcpy(&v[k], &b, sizeof(b));
+            } else {
+                v[k] = (float)((double)(pr->cents[k] + unzigzag(d)) / 100.0);
+            }
+        }
+        prev_update(pr, v);
+        s->flow_lpm = v[0];
+        s->humidity_pct = v[1];
+        s->temperature_c = v[2];
+        s->pressure_kpa = v[3];
+        s->alerts_mask = (AlertFlags)(flags & 0x1F);
+        s->flowing = (flags & 0x20) != 0;
+        s->conn = (flags & 0x40) ? CONN_CONNECTED : CONN_DISCONNECTED;
+        snprintf(s->via, sizeof(s->via), "UPLINK");
+        memcpy(s->sensor_id, ids[id], sizeof(s->sensor_id));
+    }
+    return p == end ? (int)count : -1;
+}
+
+// ---------- edge side ----------
+
+typedef struct {
+    uint64_t seq;
+    uint32_t count;
+    uint32_t len;                    // frame bytes: header + payload
+    uint64_t sent_ms;
+    unsigned char* frame;
+} WindowEntry;
+
+struct Uplink {
+    SharedState* st;
+    char host[64];
+    int port;
+    char id[32];
+    uint64_t session;
+    char spill_path[256];
+    size_t spill_max;
+    pthread_t th;
+    atomic_int stop;
+
+    // Queue between the ingest threads and the sender (guarded by mu)
+    pthread_mutex_t mu;
+    UplinkSample* q;
+    size_t qhead;
+    size_t qlen;
+
+    // Owned by the sender thread
+    int fd;
+    WindowEntry win[UPLINK_WINDOW];  // sent, not yet acked, in seq order
+    int nwin;
+    uint64_t next_seq;
+    uint64_t last_progress_ms;
+    unsigned char ack_buf[UPLINK_ACK_LEN];
+    size_t ack_len;
+    UplinkSample batch[UPLINK_BATCH_MAX]; // taken from the queue, not yet encoded
+    int nbatch;
+    unsigned char payload[UPLINK_PAYLOAD_MAX];
+    int spill_fd;
+    off_t spill_size;
+    off_t spill_off;                 // replay position
+
+    atomic_int connected;
+    atomic_int inflight;
+    atomic_uint_fast64_t enqueued;
+    atomic_uint_fast64_t dropped;    // queue full, or spill file full
+    atomic_uint_fast64_t batches_sent;
+    atomic_uint_fast64_t samples_sent;
+    atomic_uint_fast64_t bytes_sent;
+    atomic_uint_fast64_t batches_acked;
+    atomic_uint_fast64_t batches_spilled;
+    atomic_uint_fast64_t spill_bytes;
+    atomic_uint_fast64_t reconnects;
+    atomic_uint_fast64_t ack_rtt_ms;
+};
+
+static uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+void uplink_enqueue(Uplink* up, const SensorData* samples, int count, uint64_t ts_ms) {
+    int lost = 0;
+    pthread_mutex_lock(&up->mu);
+    for (int i = 0; i < count; i++) {
+        if (up->qlen == UPLINK_QUEUE_CAP) { lost++; continue; }
+        UplinkSample* slot = &up->q[(up->qhead + up->qlen) & (UPLINK_QUEUE_CAP - 1)];
+        slot->ts_ms = ts_ms;
+        slot->s = samples[i];
+        up->qlen++;
+    }
+    pthread_mutex_unlock(&up->mu);
+    atomic_fetch_add_explicit(&up->enqueued, (uint64_t)(count - lost), memory_order_relaxed);
+    if (lost) atomic_fetch_add_explicit(&up->dropped, (uint64_t)lost, memory_order_relaxed);
+}
+
+size_t uplink_queued(Uplink* up) {
+    pthread_mutex_lock(&up->mu);
+    size_t n = up->qlen;
+    pthread_mutex_unlock(&up->mu);
+    return n;
+}
+
+// Encode the next batch from the queue into up->payload. A partial batch only goes out once
+// its oldest sample has waited UPLINK_FLUSH_MS (or when force is set). Returns 1 if encoded.
+static int next_queue_batch(Uplink* up, int force, uint32_t* count, uint32_t* len) {
+    pthread_mutex_lock(&up->mu);
+    while (up->nbatch < UPLINK_BATCH_MAX && up->qlen > 0) {
+        up->batch[up->nbatch++] = up->q[up->qhead];
+        up->qhead = (up->qhead + 1) & (UPLINK_QUEUE_CAP - 1);
+        up->qlen--;
+    }
+    pthread_mutex_unlock(&up->mu);
+
+    if (up->nbatch == 0) return 0;
+    if (up->nbatch < UPLINK_BATCH_MAX && !force &&
+        history_now_ms() - up->batch[0].ts_ms < UPLINK_FLUSH_MS) return 0;
+
+    int used = 0;
+    size_t n = uplink_encode(up->batch, up->nbatch, up->payload, sizeof(up->payload), &used);
+    if (n == 0) return 0;
+    up->nbatch -= used;
+    memmove(up->batch, up->batch + used, (size_t)up->nbatch * sizeof(UplinkSample));
+    *count = (uint32_t)used;
+    *len = (uint32_t)n;
+    return 1;
+}
+
+// ----- spill file: a sequence of [u32 count][u32 len][payload] records -----
+
+static void spill_open(Uplink* up) {
+    up->spill_fd = -1;
+    if (!up->spill_path[0]) return;
+    up->spill_fd = open(up->spill_path, O_RDWR | O_CREAT, 0644);
+    if (up->spill_fd < 0) {
+        LOG_WARN("Uplink spill file %s unavailable (%s); buffering in memory only", up->spill_path, strerror(errno));
+        return;
+    }
+    up->spill_size = lseek(up->spill_fd, 0, SEEK_END);
+    if (up->spill_size > 0) LOG_INFO("Uplink: %lld bytes of spilled batches to replay", (long long)up->spill_size);
+    atomic_store(&up->spill_bytes, (uint64_t)up->spill_size);
+}
+
+static int spill_append(Uplink* up, uint32_t count, const unsigned char* payload, uint32_t len) {
+    if ((size_t)up->spill_size + SPILL_RECORD_HDR + len > up->spill_max) {
+        atomic_fetch_add_explicit(&up->dropped, count, memory_order_relaxed);
+        return -1;
+    }
+    unsigned char hdr[SPILL_RECORD_HDR];
+    put_le32(hdr, count);
+    put_le32(hdr + 4, len);
+    if (pwrite(up->spill_fd, hdr, sizeof(hdr), up->spill_size) != (ssize_t)sizeof(hdr) ||
+        pwrite(up->spill_fd, payload, len, up->spill_size + SPILL_RECORD_HDR) != (ssize_t)len) {
+        atomic_fetch_add_explicit(&up->dropped, count, memory_order_relaxed);
+        return -1;
+    }
+    up->spill_size += SPILL_RECORD_HDR + len;
+    atomic_store(&up->spill_bytes, (uint64_t)up->spill_size);
+    atomic_fetch_add_explicit(&up->batches_spilled, 1, memory_order_relaxed);
+    return 0;
+}
+
+static void spill_reset(Uplink* up) {
+    if (ftruncate(up->spill_fd, 0) != 0) LOG_WARN("Uplink spill truncate failed: %s", strerror(errno));
+    up->spill_size = 0;
+    up->spill_off = 0;
+    atomic_store(&up->spill_bytes, 0);
+}
+
+// Read the next unreplayed record into up->payload. The file is emptied once everything in it
+// has been handed to the window (the window keeps its own copy until acked).
+static int spill_next(Uplink* up, uint32_t* count, uint32_t* len) {
+    if (up->spill_fd < 0 || up->spill_off >= up->spill_size) return 0;
+    unsigned char hdr[SPILL_RECORD_HDR];
+    int ok = pread(up->spill_fd, hdr, sizeof(hdr), up->spill_off) == (ssize_t)sizeof(hdr);
+    if (ok) {
+        *count = get_le32(hdr);
+        *len = get_le32(hdr + 4);
+        ok = *len <= UPLINK_PAYLOAD_MAX && up->spill_off + SPILL_RECORD_HDR + *len <= up->spill_size &&
+             pread(up->spill_fd, up->payload, *len, up->spill_off + SPILL_RECORD_HDR) == (ssize_t)*len;
+    }
+    if (!ok) {
+        LOG_WARN("Uplink spill file %s is damaged; discarding the rest of it", up->spill_path);
+        spill_reset(up);
+        return 0;
+    }
+    up->spill_off += SPILL_RECORD_HDR + *len;
+    if (up->spill_off >= up->spill_size) spill_reset(up);
+    return 1;
+}
+
+// Shutdown with unacked batches: they are older than anything still in the file, so rewrite
+// the file as window + unreplayed remainder. spill_max still applies; like spill_append, records
+// that no longer fit are dropped (newest first, since the file is rewritten oldest first).
+static void spill_prepend_window(Uplink* up) {
+    if (up->nwin == 0 || up->spill_fd < 0) return;
+    char tmp[sizeof(up->spill_path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", up->spill_path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+
+    off_t pos = 0;
+    uint64_t dropped = 0;
+    for (int i = 0; i < up->nwin; i++) {
+        WindowEntry* w = &up->win[i];
+        unsigned char hdr[SPILL_RECORD_HDR];
+        uint32_t plen = w->len - UPLINK_BATCH_HDR;
+        if ((size_t)pos + SPILL_RECORD_HDR + plen > up->spill_max) { dropped += w->count; continue; }
+        put_le32(hdr, w->count);
+        put_le32(hdr + 4, plen);
+        if (pwrite(fd, hdr, sizeof(hdr), pos) != (ssize_t)sizeof(hdr) ||
+            pwrite(fd, w->frame + UPLINK_BATCH_HDR, plen, pos + SPILL_RECORD_HDR) != (ssize_t)plen) {
+            close(fd);
+            unlink(tmp);
+            return;
+        }
+        pos += SPILL_RECORD_HDR + plen;
+    }
+    for (off_t off = up->spill_off; off < up->spill_size;) {
+        unsigned char hdr[SPILL_RECORD_HDR];
+        if (pread(up->spill_fd, hdr, sizeof(hdr), off) != (ssize_t)sizeof(hdr)) break;
+        uint32_t count = get_le32(hdr), plen = get_le32(hdr + 4);
+        if (plen > UPLINK_PAYLOAD_MAX) break; // damaged: spill_next would discard the rest anyway
+        off_t next = off + SPILL_RECORD_HDR + plen;
+        if ((size_t)pos + SPILL_RECORD_HDR + plen > up->spill_max) {
+            dropped += count;
+            off = next;
+            continue;
+        }
+        if (pread(up->spill_fd, up->payload, plen, off + SPILL_RECORD_HDR) != (ssize_t)plen ||
+            pwrite(fd, hdr, sizeof(hdr), pos) != (ssize_t)sizeof(hdr) ||
+            pwrite(fd, up->payload, plen, pos + SPILL_RECORD_HDR) != (ssize_t)plen) {
+            close(fd);
+            unlink(tmp);
+            return;
+        }
+        off = next;
+        pos += SPILL_RECORD_HDR + plen;
+    }
+    if (rename(tmp, up->spill_path) != 0) { close(fd); unlink(tmp); return; }
+    close(up->spill_fd);
+    up->spill_fd = fd;
+    up->spill_size = pos;
+    up->spill_off = 0;
+    atomic_store(&up->spill_bytes, (uint64_t)pos);
+    if (dropped) {
+        atomic_fetch_add_explicit(&up->dropped, dropped, memory_order_relaxed);
+        LOG_WARN("Uplink spill file full: %llu unacked samples dropped", (unsigned long long)dropped);
+    }
+    for (int i = 0; i < up->nwin; i++) free(up->win[i].frame);
+    up->nwin = 0;
+    atomic_store(&up->inflight, 0);
+}
+
+// ----- connection -----
+
+static int write_all(int fd, const unsigned char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void uplink_disconnect(Uplink* up) {
+    if (up->fd < 0) return;
+    close(up->fd);
+    up->fd = -1;
+    up->ack_len = 0;
+    atomic_store(&up->connected, 0);
+    LOG_WARN("Uplink to %s:%d lost; %d batch%s awaiting ack", up->host, up->port, up->nwin, up->nwin == 1 ? "" : "es");
+}
+
+// Dial the aggregator (with a connect timeout so a black-holed host cannot hang shutdown),
+// say hello, then resend whatever was in flight when the last connection dropped.
+static int uplink_connect(Uplink* up) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", up->port);
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(up->host, port, &hints, &res) != 0 || !res) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) { freeaddrinfo(res); return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        rc = (poll(&pfd, 1, 2000) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &elen) == 0 && err == 0) ? 0 : -1;
+    }
+    if (rc != 0) { close(fd); return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 }; // a stuck aggregator turns into a reconnect
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    unsigned char hello[4 + 1 + 32 + 8];
+    size_t idlen = strlen(up->id);
+    memcpy(hello, UPLINK_MAGIC_HELLO, 4);
+    hello[4] = (unsigned char)idlen;
+    memcpy(hello + 5, up->id, idlen);
+    put_le64(hello + 5 + idlen, up->session);
+    if (write_all(fd, hello, 5 + idlen + 8) != 0) { close(fd); return -1; }
+
+    for (int i = 0; i < up->nwin; i++) {
+        if (write_all(fd, up->win[i].frame, up->win[i].len) != 0) { close(fd); return -1; }
+        up->win[i].sent_ms = mono_ms();
+    }
+
+    up->fd = fd;
+    up->last_progress_ms = mono_ms();
+    atomic_store(&up->connected, 1);
+    atomic_fetch_add_explicit(&up->reconnects, 1, memory_order_relaxed);
+    LOG_INFO("Uplink connected to %s:%d as \"%s\"", up->host, up->port, up->id);
+    return 0;
+}
+
+static int send_batch(Uplink* up, uint32_t count, uint32_t len) {
+    unsigned char* frame = malloc(UPLINK_BATCH_HDR + len);
+    if (!frame) return -1;
+    uint64_t seq = up->next_seq++;
+    memcpy(frame, UPLINK_MAGIC_BATCH, 4);
+    put_le32(frame + 4, len);
+    put_le64(frame + 8, seq);
+    put_le32(frame + 16, count);
+    memcpy(frame + UPLINK_BATCH_HDR, up->payload, len);
+
+    // Into the window first: if the write fails the batch is resent after reconnecting
+    WindowEntry* w = &up->win[up->nwin++];
+    w->seq = seq;
+    w->count = count;
+    w->len = UPLINK_BATCH_HDR + len;
+    w->sent_ms = mono_ms();
+    w->frame = frame;
+    atomic_store(&up->inflight, up->nwin);
+    if (write_all(up->fd, frame, w->len) != 0) return -1;
+
+    atomic_fetch_add_explicit(&up->batches_sent, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&up->samples_sent, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&up->bytes_sent, w->len, memory_order_relaxed);
+    return 0;
+}
+
+static void window_ack(Uplink* up, uint64_t seq) {
+    int done = 0;
+    while (done < up->nwin && up->win[done].seq <= seq) {
+        atomic_store(&up->ack_rtt_ms, mono_ms() - up->win[done].sent_ms);
+        free(up->win[done].frame);
+        done++;
+    }
+    if (done == 0) return;
+    up->nwin -= done;
+    memmove(up->win, up->win + done, (size_t)up->nwin * sizeof(WindowEntry));
+    atomic_store(&up->inflight, up->nwin);
+    atomic_fetch_add_explicit(&up->batches_acked, (uint64_t)done, memory_order_relaxed);
+    up->last_progress_ms = mono_ms();
+}
+
+static int read_acks(Uplink* up, int timeout_ms) {
+    struct pollfd pfd = { .fd = up->fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+
+    unsigned char buf[UPLINK_ACK_LEN * 64];
+    memcpy(buf, up->ack_buf, up->ack_len);
+    ssize_t n = recv(up->fd, buf + up->ack_len, sizeof(buf) - up->ack_len, MSG_DONTWAIT);
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    size_t have = up->ack_len + (size_t)n, off = 0;
+    for (; have - off >= UPLINK_ACK_LEN; off += UPLINK_ACK_LEN) {
+        if (memcmp(buf + off, UPLINK_MAGIC_ACK, 4) != 0) return -1;
+        window_ack(up, get_le64(buf + off + 4));
+    }
+    up->ack_len = have - off;
+    memcpy(up->ack_buf, buf + off, up->ack_len);
+    return 0;
+}
+
+// One round while connected: fill the window (window resends happen on connect, then the
+// spill file, then fresh samples), then wait briefly for acks.
+static int uplink_pump(Uplink* up, int force) {
+    int sent = 0;
+    while (up->nwin < UPLINK_WINDOW) {
+        uint32_t count, len;
+        if (!spill_next(up, &count, &len) && !next_queue_batch(up, force, &count, &len)) break;
+        if (send_batch(up, count, len) != 0) return -1;
+        sent = 1;
+    }
+    if (read_acks(up, sent ? 0 : 5) != 0) return -1;
+    if (up->nwin > 0 && mono_ms() - up->last_progress_ms > STALL_TIMEOUT_MS) {
+        LOG_WARN("Uplink: no ack for %d ms", STALL_TIMEOUT_MS);
+        return -1;
+    }
+    return 0;
+}
+
+// While disconnected, move ready batches to disk so the memory queue keeps absorbing bursts.
+// Without a spill file they simply wait in the queue (which drops new samples once full).
+static void spill_queue(Uplink* up, int force) {
+    if (up->spill_fd < 0) return;
+    uint32_t count, len;
+    while (next_queue_batch(up, force, &count, &len)) spill_append(up, count, up->payload, len);
+}
+
+// Shutdown: give the aggregator a moment to take everything, then park the rest on disk.
+static void uplink_drain(Uplink* up) {
+    uint64_t deadline = mono_ms() + DRAIN_TIMEOUT_MS;
+    while (up->fd >= 0 && mono_ms() < deadline) {
+        if (uplink_pump(up, 1) != 0) { uplink_disconnect(up); break; }
+        if (up->nwin == 0 && up->nbatch == 0 && uplink_queued(up) == 0 &&
+            (up->spill_fd < 0 || up->spill_off >= up->spill_size)) break;
+    }
+    if (up->fd >= 0) {
+        close(up->fd);
+        up->fd = -1;
+    }
+    spill_prepend_window(up);
+    spill_queue(up, 1);
+
+    uint64_t lost = (uint64_t)up->nbatch + uplink_queued(up);
+    for (int i = 0; i < up->nwin; i++) lost += up->win[i].count;
+    if (lost) LOG_WARN("Uplink: %llu samples not delivered", (unsigned long long)lost);
+}
+
+static void* uplink_main(void* arg) {
+    Uplink* up = (Uplink*)arg;
+    uint64_t backoff_ms = 250, next_try = 0;
+
+    while (!atomic_load(&up->stop)) {
+        if (up->fd < 0 && mono_ms() >= next_try) {
+            if (uplink_connect(up) == 0) {
+                backoff_ms = 250;
+            } else {
+                // Same doubling backoff as the TCP sensor thread, capped lower: batches are piling up
+                next_try = mono_ms() + backoff_ms;
+                if (backoff_ms < 4000) backoff_ms *= 2;
+            }
+        }
+        if (up->fd < 0) {
+            spill_queue(up, 0);
+            usleep(20000);
+            continue;
+        }
+        if (uplink_pump(up, 0) != 0) {
+            uplink_disconnect(up);
+            next_try = mono_ms() + backoff_ms;
+        }
+    }
+    uplink_drain(up);
+    return NULL;
+}
+
+Uplink* uplink_start(SharedState* st, const char* host, int port, const char* edge_id,
+                     const char* spill_path, size_t spill_max) {
+    Uplink* up = calloc(1, sizeof(Uplink));
+    if (!up) return NULL;
+    up->q = malloc(sizeof(UplinkSample) * UPLINK_QUEUE_CAP);
+    if (!up->q) { free(up); return NULL; }
+
+    up->st = st;
+    snprintf(up->host, sizeof(up->host), "%s", host);
+    up->port = port;
+    snprintf(up->id, sizeof(up->id), "%s", edge_id);
+    snprintf(up->spill_path, sizeof(up->spill_path), "%s", spill_path ? spill_path : "");
+    up->spill_max = spill_max;
+    up->session = history_now_ms();
+    up->next_seq = 1;
+    up->fd = -1;
+    pthread_mutex_init(&up->mu, NULL);
+    spill_open(up);
+
+    if (pthread_create(&up->th, NULL, uplink_main, up) != 0) {
+        if (up->spill_fd >= 0) close(up->spill_fd);
+        free(up->q);
+        free(up);
+        return NULL;
+    }
+    LOG_INFO("Uplink forwarding to %s:%d (spill: %s)", up->host, up->port, up->spill_path[0] ? up->spill_path : "off");
+    return up;
+}
+
+void uplink_stop(Uplink* up) {
+    if (!up) return;
+    atomic_store(&up->stop, 1);
+    pthread_join(up->th, NULL);
+    for (int i = 0; i < up->nwin; i++) free(up->win[i].frame);
+    if (up->spill_fd >= 0) close(up->spill_fd);
+    pthread_mutex_destroy(&up->mu);
+    free(up->q);
+    free(up);
+}
+
+int uplink_stats_json(Uplink* up, char* out, size_t outsz) {
+    uint64_t samples = atomic_load(&up->samples_sent);
+    uint64_t bytes = atomic_load(&up->bytes_sent);
+    int n = snprintf(out, outsz,
+        "{ \"upstream\": \"%s:%d\", \"id\": \"%s\", \"connected\": %d, \"queued\": %zu, \"inflight\": %d, "
+        "\"enqueued\": %llu, \"samples_sent\": %llu, \"batches_sent\": %llu, \"batches_acked\": %llu, "
+        "\"bytes_sent\": %llu, \"bytes_per_sample\": %.2f, \"ack_rtt_ms\": %llu, \"batches_spilled\": %llu, "
+        "\"spill_bytes\": %llu, \"reconnects\": %llu, \"dropped\": %llu }",
+        up->host, up->port, up->id, atomic_load(&up->connected), uplink_queued(up), atomic_load(&up->inflight),
+        (unsigned long long)atomic_load(&up->enqueued), (unsigned long long)samples,
+        (unsigned long long)atomic_load(&up->batches_sent), (unsigned long long)atomic_load(&up->batches_acked),
+        (unsigned long long)bytes, samples ? (double)bytes / (double)samples : 0.0,
+        (unsigned long long)atomic_load(&up->ack_rtt_ms), (unsigned long long)atomic_load(&up->batches_spilled),
+        (unsigned long long)atomic_load(&up->spill_bytes), (unsigned long long)atomic_load(&up->reconnects),
+        (unsigned long long)atomic_load(&up->dropped));
+    return (n < 0 || (size_t)n >= outsz) ? -1 : n;
+}
+
+// ---------- aggregator side ----------
+
+struct UplinkPeers {
+    pthread_mutex_t mu;
+    int count;
+    UplinkPeer peers[UPLINK_MAX_PEERS];
+};
+
+UplinkPeers* uplink_peers_create(void) {
+    UplinkPeers* peers = calloc(1, sizeof(UplinkPeers));
+    if (peers) pthread_mutex_init(&peers->mu, NULL);
+    return peers;
+}
+
+void uplink_peers_free(UplinkPeers* peers) {
+    if (!peers) return;
+    pthread_mutex_destroy(&peers->mu);
+    free(peers);
+}
+
+int uplink_peers_snapshot(UplinkPeers* peers, UplinkPeer* out, int max) {
+    pthread_mutex_lock(&peers->mu);
+    int n = peers->count < max ? peers->count : max;
+    memcpy(out, peers->peers, (size_t)n * sizeof(UplinkPeer));
+    pthread_mutex_unlock(&peers->mu);
+    return n;
+}
+
+int uplink_peers_stats_json(UplinkPeers* peers, char* out, size_t outsz) {
+    UplinkPeer* snap = malloc(sizeof(UplinkPeer) * UPLINK_MAX_PEERS);
+    if (!snap) return -1;
+    int count = uplink_peers_snapshot(peers, snap, UPLINK_MAX_PEERS);
+
+    size_t used = 0;
+    int n = snprintf(out, outsz, "[");
+    for (int i = 0; i < count && n >= 0 && (size_t)n < outsz - used; i++) {
+        used += (size_t)n;
+        UplinkPeer* p = &snap[i];
+        n = snprintf(out + used, outsz - used,
+            "%s{ \"id\": \"%s\", \"connections\": %d, \"batches\": %llu, \"samples\": %llu, \"bytes\": %llu, "
+            "\"duplicates\": %llu, \"lag_ms\": %llu, \"lag_max_ms\": %llu, \"lag_avg_ms\": %.1f }",
+            i ? ", " : "", p->id, p->connections, (unsigned long long)p->batches, (unsigned long long)p->samples,
+            (unsigned long long)p->bytes, (unsigned long long)p->duplicates, (unsigned long long)p->lag_ms,
+            (unsigned long long)p->lag_max_ms, p->lag_avg_ms);
+    }
+    free(snap);
+    if (n < 0 || (size_t)n >= outsz - used) return -1;
+    used += (size_t)n;
+    n = snprintf(out + used, outsz - used, "]");
+    if (n < 0 || (size_t)n >= outsz - used) return -1;
+    return (int)(used + (size_t)n);
+}
+
+static int peer_hello(UplinkPeers* peers, const char* id, uint64_t session) {
+    pthread_mutex_lock(&peers->mu);
+    int k = -1;
+    for (int i = 0; i < peers->count; i++) {
+        if (strcmp(peers->peers[i].id, id) == 0) { k = i; break; }
+    }
+    if (k < 0 && peers->count < UPLINK_MAX_PEERS) {
+        k = peers->count++;
+        memset(&peers->peers[k], 0, sizeof(UplinkPeer));
+        snprintf(peers->peers[k].id, sizeof(peers->peers[k].id), "%s", id);
+    }
+    if (k >= 0) {
+        UplinkPeer* p = &peers->peers[k];
+        if (p->session != session) {
+            // Restarted edge: its sequence numbers start over
+            p->session = session;
+            p->last_seq = 0;
+        }
+        p->connections++;
+    }
+    pthread_mutex_unlock(&peers->mu);
+    return k;
+}
+
+// Returns 1 if the batch is new and should be applied
+static int peer_batch(UplinkPeers* peers, int k, uint64_t seq, int count, size_t bytes, uint64_t lag) {
+    pthread_mutex_lock(&peers->mu);
+    UplinkPeer* p = &peers->peers[k];
+    int fresh = seq > p->last_seq;
+    if (fresh) {
+        p->last_seq = seq;
+        p->batches++;
+        p->samples += (uint64_t)count;
+        p->bytes += bytes;
+        p->lag_ms = lag;
+        if (lag > p->lag_max_ms) p->lag_max_ms = lag;
+        p->lag_avg_ms = p->batches == 1 ? (double)lag : p->lag_avg_ms + 0.1 * ((double)lag - p->lag_avg_ms);
+    } else {
+        p->duplicates++;
+    }
+    pthread_mutex_unlock(&peers->mu);
+    return fresh;
+}
+
+// "<gateway>/<sensor>" in 31 bytes; longer names keep their start and end in "~" + FNV-1a hex
+static void qualify_id(char out[32], const char* gateway, const char* sensor) {
+    char full[64];
+    int len = snprintf(full, sizeof(full), "%s/%s", gateway, sensor);
+    if (len < 32) {
+        memcpy(out, full, (size_t)len + 1);
+        return;
+    }
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)full; *p; p++) h = (h ^ *p) * 16777619u;
+    snprintf(out, 32, "%.22s~%08x", full, h);
+}
+
+static void ack_frame(UplinkRx* rx, uint64_t seq) {
+    memcpy(rx->ack, UPLINK_MAGIC_ACK, 4);
+    put_le64(rx->ack + 4, seq);
+    rx->ack_off = 0;
+    rx->ack_len = UPLINK_ACK_LEN;
+}
+
+int uplink_rx_flush(UplinkRx* rx, int fd) {
+    while (rx->ack_off < rx->ack_len) {
+        ssize_t n = write(fd, rx->ack + rx->ack_off, rx->ack_len - rx->ack_off);
+        if (n > 0) {
+            rx->ack_off += (size_t)n;
+            if (rx->ack_off == rx->ack_len && rx->ack_next) {
+                ack_frame(rx, rx->ack_next);
+                rx->ack_next = 0;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0; // rest goes on POLLOUT
+        return -1;
+    }
+    return 0;
+}
+
+int uplink_rx_want_write(const UplinkRx* rx) {
+    return rx->ack_off < rx->ack_len;
+}
+
+// Acks are cumulative, so while one frame is still half-written only the newest seq has to
+// follow it; the shard never waits for room in the socket.
+static int queue_ack(UplinkRx* rx, int fd, uint64_t seq) {
+    if (uplink_rx_want_write(rx)) {
+        rx->ack_next = seq;
+        return 0;
+    }
+    ack_frame(rx, seq);
+    return uplink_rx_flush(rx, fd);
+}
+
+static int rx_batch(SharedState* st, UplinkRx* rx, const unsigned char* frame, uint32_t len) {
+    uint64_t seq = get_le64(frame + 8);
+    uint32_t count = get_le32(frame + 16);
+    if (rx->peer < 0 || count == 0 || count > UPLINK_BATCH_MAX) return -1;
+    if (!rx->scratch) {
+        rx->scratch = malloc(sizeof(UplinkSample) * UPLINK_BATCH_MAX);
+        rx->samples = malloc(sizeof(SensorData) * UPLINK_BATCH_MAX);
+        if (!rx->scratch || !rx->samples) return -1;
+    }
+    int n = uplink_decode(frame + UPLINK_BATCH_HDR, len, rx->scratch, UPLINK_BATCH_MAX);
+    if (n != (int)count) return -1;
+
+    // Lag is measured on the newest sample: how far behind the edge this aggregator is
+    uint64_t now = history_now_ms();
+    uint64_t newest = rx->scratch[n - 1].ts_ms;
+    uint64_t lag = now > newest ? now - newest : 0;
+    if (!peer_batch(st->uplink_peers, rx->peer, seq, n, UPLINK_BATCH_HDR + len, lag)) return 0;
+
+    for (int i = 0; i < n; i++) {
+        rx->samples[i] = rx->scratch[i].s;
+        qualify_id(rx->samples[i].sensor_id, rx->id, rx->scratch[i].s.sensor_id);
+    }
+    state_publish_batch(st, rx->samples, n);
+    return 0;
+}
+
+int uplink_rx_feed(SharedState* st, int shard, UplinkRx* rx, int fd, const char* data, size_t n) {
+    if (!st->uplink_peers) return -1;
+    if (rx->len + n > rx->cap) {
+        size_t cap = rx->cap ? rx->cap : 4096;
+        while (cap < rx->len + n) cap *= 2;
+        if (cap > 2 * (UPLINK_BATCH_HDR + UPLINK_PAYLOAD_MAX)) return -1;
+        unsigned char* grown = realloc(rx->buf, cap);
+        if (!grown) return -1;
+        rx->buf = grown;
+        rx->cap = cap;
+    }
+    memcpy(rx->buf + rx->len, data, n);
+    rx->len += n;
+
+    size_t off = 0;
+    uint64_t ack = 0;
+    int rc = 0;
+    while (rx->len - off >= 4) {
+        const unsigned char* f = rx->buf + off;
+        size_t have = rx->len - off;
+        if (memcmp(f, UPLINK_MAGIC_HELLO, 4) == 0) {
+            if (have < 5 || have < 5u + f[4] + 8u) break;
+            size_t idlen = f[4];
+            if (idlen == 0 || idlen > 31 || rx->peer >= 0) { rc = -1; break; }
+            char id[32];
+            memcpy(id, f + 5, idlen);
+            id[idlen] = 0;
+            if (!sensor_id_valid(id)) { rc = -1; break; }
+            rx->peer = peer_hello(st->uplink_peers, id, get_le64(f + 5 + idlen));
+            memcpy(rx->id, id, sizeof(id));
+            if (rx->peer < 0) { rc = -1; break; }
+            LOG_INFO("Uplink from gateway \"%s\" on shard %d", id, shard);
+            off += 5 + idlen + 8;
+        } else if (memcmp(f, UPLINK_MAGIC_BATCH, 4) == 0) {
+            if (have < UPLINK_BATCH_HDR) break;
+            uint32_t len = get_le32(f + 4);
+            if (len > UPLINK_PAYLOAD_MAX) { rc = -1; break; }
+            if (have < UPLINK_BATCH_HDR + len) break;
+            if (rx_batch(st, rx, f, len) != 0) { rc = -1; break; }
+            ack = get_le64(f + 8);
+            off += UPLINK_BATCH_HDR + len;
+        } else {
+            rc = -1;
+            break;
+        }
+    }
+    rx->len -= off;
+    memmove(rx->buf, rx->buf + off, rx->len);
+
+    // One cumulative ack per read; the edge keeps batches until they are covered by one
+    if (ack && queue_ack(rx, fd, ack) != 0) rc = -1;
+    return rc;
+}
+
+void uplink_rx_close(SharedState* st, UplinkRx* rx) {
+    if (rx->peer >= 0 && st->uplink_peers) {
+        pthread_mutex_lock(&st->uplink_peers->mu);
+        st->uplink_peers->peers[rx->peer].connections--;
+        pthread_mutex_unlock(&st->uplink_peers->mu);
+    }
+    free(rx->buf);
+    free(rx->scratch);
+    free(rx->samples);
+}
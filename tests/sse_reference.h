@@ -0,0 +1,59 @@
+#ifndef SSE_REFERENCE_H
+#define SSE_REFERENCE_H
+#include <stdio.h>
+#include <string.h>
+#include "shared.h"
+
+// The original snprintf/strncat dashboard formatter, kept verbatim as the reference the
+// table-driven serializer (src/serialize.c) must match byte for byte. Used by
+// tests/test_serialize.c and bench/bench_serialize.c only.
+
+// Safer strcat for fixed buffers
+static void cat_safe(char* dst, size_t dstsz, const char* src) {
+    size_t len = strlen(dst);
+    if (len >= dstsz - 1) return;
+    strncat(dst, src, dstsz - len - 1);
+}
+
+// Fill both JSON alert list and human summary
+static void build_alerts(AlertFlags mask, char* list_out, size_t list_sz, char* summary_out, size_t sum_sz) {
+    int first = 1;
+    list_out[0] = '['; list_out[1] = 0;
+    summary_out[0] = 0;
+
+#define ADD(alert_flag, code, label) \
+    if (mask & alert_flag) { \
+        if (!first) { cat_safe(list_out, list_sz, ","); cat_safe(summary_out, sum_sz, ", "); } \
+        cat_safe(list_out, list_sz, "\"" code "\""); \
+        cat_safe(summary_out, sum_sz, label); \
+        first = 0; \
+    }
+    ADD(ALERTF_HIGH_FLOW, "HIGH_FLOW", "High flow");
+    ADD(ALERTF_LOW_FLOW, "LOW_FLOW", "Low flow");
+    ADD(ALERTF_HIGH_HUMIDITY, "HIGH_HUMIDITY", "High humidity");
+    ADD(ALERTF_HIGH_TEMP, "HIGH_TEMP", "High temperature");
+    ADD(ALERTF_HIGH_PRESSURE, "HIGH_PRESSURE", "High pressure");
+#undef ADD
+
+    if (first) {
+        // No alerts at all
+        strncpy(list_out, "[]", list_sz);
+        list_out[list_sz - 1] = 0;
+        strncpy(summary_out, "None", sum_sz);
+        summary_out[sum_sz - 1] = 0;
+        return;
+    }
+    cat_safe(list_out, list_sz, "]");
+}
+
+static void reference_json_for_current(const SensorData* d, char* out, size_t outsz) {
+    const char* conn = d->conn == CONN_CONNECTED ? "CONNECTED" : "DISCONNECTED";
+    char alert_list[128];
+    char alert_summary[128];
+    build_alerts(d->alerts_mask, alert_list, sizeof(alert_list), alert_summary, sizeof(alert_summary));
+    snprintf(out, outsz,
+        "{ \"flow_lpm\": %.2f, \"humidity_pct\": %.2f, \"temperature_c\": %.2f, \"pressure_kpa\": %.2f, \"alerts\": %s, \"connection\": \"%s\", \"via\": \"%s\", \"seq\": %llu, \"alert_summary\": \"%s\" }",
+        d->flow_lpm, d->humidity_pct, d->temperature_c, d->pressure_kpa, alert_list, conn, d->via, (unsigned long long)d->last_seq, alert_summary);
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "export.h"
+
+// Checks for /export: the response is valid chunked HTTP whatever the format, CSV and NDJSON
+// carry exactly the rows in [from, to), and the Arrow stream has a schema, record batches that
+// add up to the same rows and the end-of-stream marker. An export cut short by shutdown, or by
+// ingest overwriting records it had not read yet, must not end like a complete one.
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+#define NRECS 10000
+#define BASE_TS 1700000000000ULL
+
+static void fill(History* h) {
+    HistorySample r;
+    for (int i = 0; i < NRECS; i++) {
+        memset(&r, 0, sizeof(r));
+        r.ts_ms = BASE_TS + (uint64_t)i;
+        // One id needs CSV quoting and JSON escaping
+        if (i % 1000 == 7) snprintf(r.sensor_id, sizeof(r.sensor_id), "odd,\"id\"");
+        else snprintf(r.sensor_id, sizeof(r.sensor_id), "tank-%d", i % 13);
+        r.flow_lpm = (float)(i % 40) + 0.25f;
+        r.humidity_pct = 41.5f;
+        r.temperature_c = 21.0f;
+        r.pressure_kpa = 101.3f;
+        r.alerts_mask = (uint32_t)(i % 3);
+        r.flowing = (uint32_t)(i & 1);
+        history_append_records(h, &r, 1);
+    }
+}
+
+// Run an export into a temp file and return the de-chunked body (malloc'd), or NULL if the
+// response framing is wrong. *chunks receives the number of data chunks seen.
+static char* run_export(History* h, const char* query, size_t* body_len, int* chunks, ExportResult* res) {
+    ExportQuery q;
+    if (export_parse_query(query, &q) != 0) return NULL;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/aquaguard_export_test_%d", (int)getpid());
+    FILE* f = fopen(path, "w+");
+    if (!f) return NULL;
+    unlink(path);
+    if (export_http(h, &q, fileno(f), NULL, res) != 0) { fclose(f); return NULL; }
+
+    fseek(f, 0, SEEK_END);
+    long raw_len = ftell(f);
+    rewind(f);
+    char* raw = malloc((size_t)raw_len + 1);
+    size_t got = fread(raw, 1, (size_t)raw_len, f);
+    fclose(f);
+    raw[got] = 0;
+
+    char* p = strstr(raw, "\r\n\r\n");
+    char* body = malloc((size_t)raw_len + 1);
+    *body_len = 0;
+    *chunks = 0;
+    if (!p || !strstr(raw, "Transfer-Encoding: chunked")) { free(raw); free(body); return NULL; }
+    p += 4;
+    for (;;) {
+        char* end;
+        unsigned long n = strtoul(p, &end, 16);
+        if (end == p || end[0] != '\r' || end[1] != '\n') break;
+        p = end + 2;
+        if (n == 0) {
+            int ok = p + 2 == raw + got && p[0] == '\r' && p[1] == '\n';
+            free(raw);
+            if (!ok) { free(body); return NULL; }
+            body[*body_len] = 0;
+            return body;
+        }
+        if (p + n + 2 > raw + got || p[n] != '\r' || p[n + 1] != '\n') break;
+        memcpy(body + *body_len, p, n);
+        *body_len += n;
+        (*chunks)++;
+        p += n + 2;
+    }
+    free(raw);
+    free(body);
+    return NULL;
+}
+
+static int count_lines(const char* s) {
+    int n = 0;
+    for (; *s; s++) n += *s == '\n';
+    return n;
+}
+
+static int test_query(void) {
+    int ok = 1;
+    ExportQuery q;
+    ok &= expect(export_parse_query(NULL, &q) == 0 && q.format == EXPORT_CSV && q.from_ms == 0 && q.to_ms == UINT64_MAX,
+                 "no query should export everything as CSV");
+    ok &= expect(export_parse_query("from=5&to=9&format=arrow", &q) == 0 && q.from_ms == 5 && q.to_ms == 9 &&
+                 q.format == EXPORT_ARROW, "from/to/format not parsed");
+    ok &= expect(export_parse_query("from=&format=ndjson", &q) == 0 && q.from_ms == 0 && q.format == EXPORT_NDJSON,
+                 "empty bound should mean unbounded");
+    ok &= expect(export_parse_query("format=xml", &q) != 0, "unknown format should be rejected");
+    ok &= expect(export_parse_query("from=12abc", &q) != 0, "malformed number should be rejected");
+    ok &= expect(export_parse_query("from=-1", &q) != 0, "negative number should be rejected");
+    ok &= expect(export_parse_query("from=9&to=5", &q) != 0, "from > to should be rejected");
+    return ok;
+}
+
+static int test_text(History* h) {
+    int ok = 1;
+    size_t len;
+    int chunks;
+    ExportResult res;
+
+    char* csv = run_export(h, NULL, &len, &chunks, &res);
+    ok &= expect(csv != NULL, "CSV response is not valid chunked HTTP");
+    if (!csv) return 0;
+    ok &= expect(strncmp(csv, "ts_ms,sensor_id,flow_lpm,", 25) == 0, "CSV header missing");
+    ok &= expect(count_lines(csv) == NRECS + 1, "CSV should have a header and every row");
+    ok &= expect(res.rows == NRECS, "result should count every row");
+    ok &= expect(chunks > 1 && (uint64_t)chunks == res.chunks, "large export should span several chunks");
+    ok &= expect(strstr(csv, "\n1700000000007,\"odd,\"\"id\"\"\",7.25,41.50,21.00,101.30,1,1\n") != NULL,
+                 "CSV row with a quoted id is wrong");
+    free(csv);
+
+    // [from, to) picks 100 rows, starting at from
+    char query[96];
+    snprintf(query, sizeof(query), "from=%llu&to=%llu&format=csv", (unsigned long long)(BASE_TS + 500),
+             (unsigned long long)(BASE_TS + 600));
+    csv = run_export(h, query, &len, &chunks, &res);
+    ok &= expect(csv && count_lines(csv) == 101 && res.rows == 100, "range export should have 100 rows");
+    ok &= expect(csv && strncmp(strchr(csv, '\n') + 1, "1700000000500,", 14) == 0, "range should start at from");
+    free(csv);
+
+    char* nd = run_export(h, "format=ndjson&from=1700000009000", &len, &chunks, &res);
+    ok &= expect(nd && count_lines(nd) == 1000, "NDJSON should have one line per row");
+    ok &= expect(nd && strstr(nd, "{\"ts_ms\":1700000009007,\"sensor_id\":\"odd,\\\"id\\\"\",\"flow_lpm\":7.25,") != NULL,
+                 "NDJSON row with an escaped id is wrong");
+    free(nd);
+
+    // Nothing in range: still a complete response with just the header
+    csv = run_export(h, "from=1&to=2", &len, &chunks, &res);
+    ok &= expect(csv && count_lines(csv) == 1 && res.rows == 0, "empty range should return only the header");
+    free(csv);
+    return ok;
+}
+
+// ---- minimal flatbuffer reading for the Arrow check ----
+
+static uint32_t rd32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t rd64(const unsigned char* p) {
+    return (uint64_t)rd32(p) | (uint64_t)rd32(p + 4) << 32;
+}
+
+// Position of field `id` in table t, or 0 if absent
+static size_t fb_field(const unsigned char* buf, size_t t, int id) {
+    size_t vt = t - (size_t)(int32_t)rd32(buf + t);
+    uint16_t vtsize = (uint16_t)(buf[vt] | buf[vt + 1] << 8);
+    if (4 + 2 * (size_t)id >= vtsize) return 0;
+    uint16_t off = (uint16_t)(buf[vt + 4 + 2 * id] | buf[vt + 5 + 2 * id] << 8);
+    return off ? t + off : 0;
+}
+
+static size_t fb_deref(const unsigned char* buf, size_t field) {
+    return field + rd32(buf + field);
+}
+
+static int test_arrow(History* h) {
+    int ok = 1;
+    size_t len;
+    int chunks;
+    ExportResult res;
+    unsigned char* s = (unsigned char*)run_export(h, "format=arrow&from=1700000000100", &len, &chunks, &res);
+    ok &= expect(s != NULL, "Arrow response is not valid chunked HTTP");
+    if (!s) return 0;
+
+    size_t pos = 0;
+    int messages = 0, schemas = 0, eos = 0;
+    uint64_t rows = 0, first_ts = 0;
+    while (pos + 8 <= len) {
+        ok &= expect(rd32(s + pos) == 0xFFFFFFFFu, "message must start with the continuation marker");
+        uint32_t meta_len = rd32(s + pos + 4);
+        if (meta_len == 0) { eos = 1; pos += 8; break; }
+        ok &= expect((8 + meta_len) % 8 == 0, "metadata must keep the body 8-byte aligned");
+        const unsigned char* fb = s + pos + 8;
+        size_t msg = rd32(fb);
+        size_t ht = fb_field(fb, msg, 1);
+        size_t body_field = fb_field(fb, msg, 3);
+        uint64_t body_len = body_field ? rd64(fb + body_field) : 0;
+        ok &= expect(rd32(fb + fb_field(fb, msg, 0)) % 65536 == 4, "metadata version should be V5");
+        if (ht && fb[ht] == 1) {
+            schemas++;
+            size_t schema = fb_deref(fb, fb_field(fb, msg, 2));
+            size_t fields = fb_deref(fb, fb_field(fb, schema, 1));
+            ok &= expect(rd32(fb + fields) == 8, "schema should have 8 fields");
+        } else if (ht && fb[ht] == 3) {
+            size_t rb = fb_deref(fb, fb_field(fb, msg, 2));
+            uint64_t n = rd64(fb + fb_field(fb, rb, 0));
+            size_t bufs = fb_deref(fb, fb_field(fb, rb, 2));
+            ok &= expect(rd32(fb + bufs) == 17, "record batch should list 17 buffers");
+            // Buffer 1 is the ts_ms column
+            const unsigned char* body = fb + meta_len;
+            uint64_t ts_off = rd64(fb + bufs + 4 + 16);
+            if (rows == 0 && n > 0) first_ts = rd64(body + ts_off);
+            ok &= expect(n <= EXPORT_WINDOW, "batch larger than a window");
+            rows += n;
+        }
+        messages++;
+        pos += 8 + meta_len + body_len;
+    }
+    ok &= expect(schemas == 1 && messages > 2, "expected one schema and several batches");
+    ok &= expect(eos && pos == len, "stream should end with the end-of-stream marker");
+    ok &= expect(rows == NRECS - 100 && res.rows == rows, "batch lengths should add up to the rows in range");
+    ok &= expect(first_ts == BASE_TS + 100, "first ts_ms value is wrong");
+    free(s);
+    return ok;
+}
+
+static int test_stopped(History* h) {
+    int ok = 1;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/aquaguard_export_test_%d", (int)getpid());
+    FILE* f = fopen(path, "w+");
+    if (!f) return 0;
+    unlink(path);
+    ExportQuery q;
+    export_parse_query("format=arrow", &q);
+    atomic_int stop = 1;
+    ExportResult res;
+    ok &= expect(export_http(h, &q, fileno(f), &stop, &res) == -1, "an export stopped early should fail");
+    ok &= expect(res.rows == 0, "no rows should be counted when none were sent");
+
+    char raw[1024];
+    rewind(f);
+    size_t got = fread(raw, 1, sizeof(raw) - 1, f);
+    fclose(f);
+    raw[got] = 0;
+    ok &= expect(got >= 5 && memcmp(raw + got - 5, "0\r\n\r\n", 5) != 0,
+                 "a cut-short response must not carry the terminating chunk");
+    return ok;
+}
+
+// Stamps never go backwards, even when the newest record is ahead of the clock (a snapshot
+// written before the wall clock was stepped back), so history_seek's binary search holds
+static int test_monotonic(void) {
+    int ok = 1;
+    History h;
+    if (history_init(&h, 16) != 0) return 0;
+    HistorySample r;
+    memset(&r, 0, sizeof(r));
+    r.ts_ms = history_now_ms() + 60000;
+    history_append_records(&h, &r, 1);
+
+    SensorData s[3];
+    memset(s, 0, sizeof(s));
+    uint64_t first = history_append_batch(&h, s, 3);
+    uint64_t second = history_append_batch(&h, s, 3);
+    ok &= expect(first == r.ts_ms && second == r.ts_ms, "new stamps should not fall behind the newest record");
+    uint64_t end;
+    ok &= expect(history_seek(&h, r.ts_ms, &end) == 0 && end == 7, "seek should find every record at the clamped stamp");
+    history_free(&h);
+    return ok;
+}
+
+typedef struct {
+    History* h;
+    int fd;
+    int rc;
+    atomic_int go;                   // reader: start draining the socket
+    char* body;
+    size_t len;
+} SlowClient;
+
+static void* export_thread(void* arg) {
+    SlowClient* c = (SlowClient*)arg;
+    ExportQuery q;
+    export_parse_query(NULL, &q);
+    c->rc = export_http(c->h, &q, c->fd, NULL, NULL);
+    shutdown(c->fd, SHUT_WR);
+    return NULL;
+}
+
+static void* reader_thread(void* arg) {
+    SlowClient* c = (SlowClient*)arg;
+    while (!atomic_load(&c->go)) usleep(1000);
+    size_t cap = 1 << 20;
+    c->body = malloc(cap);
+    ssize_t r;
+    while (c->body && (r = read(c->fd, c->body + c->len, cap - c->len)) > 0) {
+        c->len += (size_t)r;
+        if (c->len == cap) c->body = realloc(c->body, cap *= 2);
+    }
+    return NULL;
+}
+
+// The client stalls after the first windows; ingest wraps the ring before the rest is read
+static int test_overwritten(void) {
+    int ok = 1;
+    History h;
+    if (history_init(&h, 4 * EXPORT_WINDOW) != 0) return 0;
+    HistorySample r;
+    memset(&r, 0, sizeof(r));
+    snprintf(r.sensor_id, sizeof(r.sensor_id), "tank");
+    for (int i = 0; i < 4 * EXPORT_WINDOW; i++) {
+        r.ts_ms = BASE_TS + (uint64_t)i;
+        history_append_records(&h, &r, 1);
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+    int small = 4096;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    SlowClient wr = { &h, sv[0], 0, 0, NULL, 0 }, rd = { &h, sv[1], 0, 0, NULL, 0 };
+    pthread_t tw, tr;
+    pthread_create(&tw, NULL, export_thread, &wr);
+    pthread_create(&tr, NULL, reader_thread, &rd);
+    usleep(200000);                  // the exporter is now blocked writing its first chunk
+    for (int i = 0; i < 8 * EXPORT_WINDOW; i++) {
+        r.ts_ms = BASE_TS + (uint64_t)(4 * EXPORT_WINDOW + i);
+        history_append_records(&h, &r, 1);
+    }
+    atomic_store(&rd.go, 1);
+    pthread_join(tw, NULL);
+    pthread_join(tr, NULL);
+
+    ok &= expect(wr.rc == -1, "an export that lost records to ingest should fail");
+    ok &= expect(rd.body && rd.len >= 5 && memcmp(rd.body + rd.len - 5, "0\r\n\r\n", 5) != 0,
+                 "a gapped export must not carry the terminating chunk");
+    free(rd.body);
+    close(sv[0]);
+    close(sv[1]);
+    history_free(&h);
+    return ok;
+}
+
+int main() {
+    History h;
+    if (history_init(&h, NRECS) != 0) return 1;
+    fill(&h);
+    int ok = 1;
+    ok &= test_query();
+    ok &= test_text(&h);
+    ok &= test_arrow(&h);
+    ok &= test_stopped(&h);
+    ok &= test_monotonic();
+    ok &= test_overwritten();
+    history_free(&h);
+    if (!ok) return 1;
+    printf("export tests passed\n");
+    return 0;
+}
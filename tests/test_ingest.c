@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ingest.h"
+#include "state.h"
+
+// Functional checks for the sharded listener: devices connect over loopback, their connections
+// spread over both shards, and an id that reconnects (even on another shard, before the old
+// connection is gone) stays one device that reads connected until its last connection closes.
+
+#define SHARDS 2
+#define CONNS 16                 // enough that SO_REUSEPORT puts some on each shard
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int dial(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("connect failed\n");
+        exit(1);
+    }
+    return fd;
+}
+
+static void send_line(int fd, const char* line) {
+    if (write(fd, line, strlen(line)) != (ssize_t)strlen(line)) printf("short write\n");
+}
+
+// The shards apply samples asynchronously: wait until the device shows the wanted state
+static int wait_device(SharedState* st, const char* id, ConnectionStatus conn, uint64_t seq_at_least) {
+    for (int i = 0; i < 200; i++) {
+        SensorData d;
+        if (state_device(st, id, &d) == 0 && d.conn == conn && d.last_seq >= seq_at_least) return 1;
+        sleep_ms(10);
+    }
+    return 0;
+}
+
+static int count_devices(SharedState* st) {
+    static SensorData all[MAX_DEVICES * SHARDS];
+    return state_merged_devices(st, all, NULL, MAX_DEVICES * SHARDS);
+}
+
+static int test_reconnect(SharedState* st) {
+    int ok = 1;
+    const char* line = "{\"sensor_id\":\"pump-1\",\"flow_lpm\":10,\"humidity_pct\":40}\n";
+    int fds[CONNS];
+    for (int i = 0; i < CONNS; i++) {
+        fds[i] = dial(st->ingest_port);
+        send_line(fds[i], line);
+    }
+    ok &= expect(wait_device(st, "pump-1", CONN_CONNECTED, CONNS), "every connection's sample should reach pump-1");
+    int busy = 0;
+    for (int s = 0; s < SHARDS; s++) busy += atomic_load(&st->shards[s].active) > 0;
+    ok &= expect(busy == SHARDS, "connections should spread over both shards");
+    ok &= expect(count_devices(st) == 1, "one id on many shards must stay one device");
+
+    // Old connections close after the newest one is up: the device must stay connected
+    for (int i = 0; i < CONNS - 1; i++) close(fds[i]);
+    for (int i = 0; i < 20; i++) {
+        int active = 0;
+        for (int s = 0; s < SHARDS; s++) active += atomic_load(&st->shards[s].active);
+        if (active == 1) break;
+        sleep_ms(10);
+    }
+    SensorData d;
+    ok &= expect(state_device(st, "pump-1", &d) == 0 && d.conn == CONN_CONNECTED,
+                 "closing old connections must not mark a reconnected device down");
+
+    close(fds[CONNS - 1]);
+    ok &= expect(wait_device(st, "pump-1", CONN_DISCONNECTED, 0), "the last close should mark the device down");
+    ok &= expect(count_devices(st) == 1, "reconnects must not add devices");
+    return ok;
+}
+
+// Devices without an id share their address's entry; one of them leaving keeps it connected
+static int test_shared_address(SharedState* st) {
+    int ok = 1;
+    const char* line = "{\"flow_lpm\":12,\"humidity_pct\":40}\n";
+    int a = dial(st->ingest_port), b = dial(st->ingest_port);
+    send_line(a, line);
+    send_line(b, line);
+    ok &= expect(wait_device(st, "127.0.0.1", CONN_CONNECTED, 2), "id-less samples should land on the address");
+    close(a);
+    sleep_ms(100);
+    SensorData d;
+    ok &= expect(state_device(st, "127.0.0.1", &d) == 0 && d.conn == CONN_CONNECTED,
+                 "one device leaving must not mark the shared address down");
+    close(b);
+    ok &= expect(wait_device(st, "127.0.0.1", CONN_DISCONNECTED, 0), "the address goes down with its last device");
+    return ok;
+}
+
+int main(void) {
+    SharedState st;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_init(&st.mu, NULL);
+    st.mode = MODE_LISTEN;
+    st.nshards = SHARDS;
+    st.ingest_port = 0;
+    if (state_init_slices(&st, SHARDS) != 0 || ingest_start(&st) != 0) {
+        printf("ingest did not start\n");
+        return 1;
+    }
+
+    int ok = 1;
+    ok &= test_reconnect(&st);
+    ok &= test_shared_address(&st);
+    ingest_stop(&st);
+    free(st.slices);
+    if (!ok) return 1;
+    printf("ingest tests passed\n");
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "notify.h"
+#include "devices.h"
+#include "state.h"
+
+// Checks for alert notifications: the device table reports only mask edges, and the dispatcher
+// delivers every edge to a local HTTP stand-in (reusing one connection and retrying 503s), or
+// dead-letters it once the receiver stays unreachable. A receiver that never answers must not
+// delay delivery to the others.
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+// ---- webhook stand-in: answers 503 to the first `fail_first` requests, 200 afterwards ----
+
+typedef struct {
+    int listen_fd;
+    int port;
+    int fail_first;
+    atomic_int stop;
+    atomic_int connections;
+    atomic_int requests;
+    atomic_int events;             // "sensor_id" occurrences in accepted (200) bodies
+    pthread_t th;
+} StandIn;
+
+static int count_events(const char* body) {
+    int n = 0;
+    for (const char* p = strstr(body, "\"sensor_id\""); p; p = strstr(p + 1, "\"sensor_id\"")) n++;
+    return n;
+}
+
+// Serve one keep-alive connection until the client closes it
+static void serve(StandIn* s, int fd) {
+    static char buf[1 << 17];
+    size_t len = 0;
+    while (!atomic_load(&s->stop)) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        ssize_t r = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (r <= 0) return;
+        len += (size_t)r;
+        buf[len] = 0;
+
+        char* end;
+        while ((end = strstr(buf, "\r\n\r\n")) != NULL) {
+            const char* cl = strstr(buf, "Content-Length: ");
+            size_t body_len = cl && cl < end ? (size_t)atol(cl + 16) : 0;
+            size_t need = (size_t)(end + 4 - buf) + body_len;
+            if (len < need) break;
+
+            int nth = atomic_fetch_add(&s->requests, 1);
+            const char* reply;
+            if (nth < s->fail_first) {
+                reply = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 4\r\n\r\nbusy";
+            } else {
+                char saved = buf[need];
+                buf[need] = 0;
+                atomic_fetch_add(&s->events, count_events(end + 4));
+                buf[need] = saved;
+                reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            }
+            if (write(fd, reply, strlen(reply)) < 0) return;
+            memmove(buf, buf + need, len - need);
+            len -= need;
+            buf[len] = 0;
+        }
+    }
+}
+
+static void* standin_main(void* arg) {
+    StandIn* s = (StandIn*)arg;
+    while (!atomic_load(&s->stop)) {
+        struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        atomic_fetch_add(&s->connections, 1);
+        serve(s, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void standin_start(StandIn* s, int fail_first) {
+    memset(s, 0, sizeof(*s));
+    s->fail_first = fail_first;
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(s->listen_fd, 8);
+    socklen_t alen = sizeof(addr);
+    getsockname(s->listen_fd, (struct sockaddr*)&addr, &alen);
+    s->port = ntohs(addr.sin_port);
+    pthread_create(&s->th, NULL, standin_main, s);
+}
+
+static void standin_stop(StandIn* s) {
+    atomic_store(&s->stop, 1);
+    pthread_join(s->th, NULL);
+    close(s->listen_fd);
+}
+
+// ---- helpers ----
+
+static void sample(SensorData* s, const char* id, AlertFlags mask) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->sensor_id, sizeof(s->sensor_id), "%s", id);
+    s->flow_lpm = 5.0f;
+    s->pressure_kpa = mask & ALERTF_HIGH_PRESSURE ? 130.0f : 101.3f;
+    s->alerts_mask = mask;
+    s->conn = CONN_CONNECTED;
+}
+
+static unsigned long long stat_value(Notifier* n, const char* key) {
+    char buf[4096];
+    notify_stats_json(n, buf, sizeof(buf));
+    const char* p = strstr(buf, key);
+    return p ? strtoull(p + strlen(key) + 3, NULL, 10) : 0; // skip `": `
+}
+
+static int wait_stat(Notifier* n, const char* key, unsigned long long want) {
+    for (int tries = 0; tries < 200; tries++) {
+        if (stat_value(n, key) == want) return 1;
+        usleep(20000);
+    }
+    return 0;
+}
+
+static void state_with_webhook(SharedState* st, const char* url, const char* dead) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+    state_init_slices(st, 1);
+    snprintf(st->uplink_id, sizeof(st->uplink_id), "test-gw");
+    snprintf(st->webhook_urls[0], sizeof(st->webhook_urls[0]), "%s", url);
+    st->nwebhooks = 1;
+    snprintf(st->dead_letter_path, sizeof(st->dead_letter_path), "%s", dead);
+}
+
+// ---- tests ----
+
+static int test_detector(void) {
+    int ok = 1;
+    DeviceTable* t = malloc(sizeof(DeviceTable));
+    device_table_init(t);
+
+    SensorData b[6];
+    const AlertFlags masks[5] = { ALERTF_NONE, ALERTF_HIGH_FLOW, ALERTF_HIGH_FLOW,
+                                  ALERTF_HIGH_FLOW | ALERTF_HIGH_TEMP, ALERTF_NONE };
+    for (int i = 0; i < 5; i++) sample(&b[i], "a", masks[i]);
+    sample(&b[5], "b", ALERTF_HIGH_PRESSURE); // first sample of a new device already alarming
+
+    AlertTransition tr[8];
+    int n = device_table_apply(t, b, 6, tr, 8);
+    ok &= expect(n == 4, "expected 4 edges (raise, raise, clear, new device raise)");
+    ok &= expect(tr[0].index == 1 && tr[0].prev_mask == ALERTF_NONE, "edge 0 wrong");
+    ok &= expect(tr[1].index == 3 && tr[1].prev_mask == ALERTF_HIGH_FLOW, "edge 1 wrong");
+    ok &= expect(tr[2].index == 4 && tr[2].prev_mask == (ALERTF_HIGH_FLOW | ALERTF_HIGH_TEMP), "edge 2 wrong");
+    ok &= expect(tr[3].index == 5 && tr[3].prev_mask == ALERTF_NONE, "edge 3 wrong");
+
+    // Same masks again: the level did not change, so no edges
+    ok &= expect(device_table_apply(t, &b[4], 2, tr, 8) == 0, "repeated masks must not produce edges");
+    // More edges than room: all are counted, only max are written
+    SensorData flip[4];
+    for (int i = 0; i < 4; i++) sample(&flip[i], "a", (i & 1) ? ALERTF_NONE : ALERTF_LOW_FLOW);
+    ok &= expect(device_table_apply(t, flip, 4, tr, 2) == 4, "overflowing edges should still be counted");
+    free(t);
+    return ok;
+}
+
+static int test_full_table(void) {
+    int ok = 1;
+    DeviceTable* t = malloc(sizeof(DeviceTable));
+    device_table_init(t);
+    SensorData s;
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        char id[16];
+        snprintf(id, sizeof(id), "d%d", i);
+        sample(&s, id, ALERTF_NONE);
+        device_table_apply(t, &s, 1, NULL, 0);
+    }
+    sample(&s, "late", ALERTF_NONE);
+    device_table_apply(t, &s, 1, NULL, 0);
+    ok &= expect(t->count == MAX_DEVICES && t->dropped == 1, "a full table of connected devices should drop newcomers");
+
+    // Once a device has gone away its entry is reused, and the newcomer starts from no alerts
+    device_table_set_conn(t, "d7", CONN_DISCONNECTED);
+    sample(&s, "late", ALERTF_HIGH_FLOW);
+    AlertTransition tr[2];
+    ok &= expect(device_table_apply(t, &s, 1, tr, 2) == 1, "newcomer should raise from an empty mask");
+    ok &= expect(t->dropped == 1 && strcmp(t->devices[7].sensor_id, "late") == 0 && t->devices[7].last_seq == 1,
+                 "newcomer should take over the disconnected entry");
+    free(t);
+    return ok;
+}
+
+static int test_delivery(void) {
+    int ok = 1;
+    StandIn s;
+    standin_start(&s, 2);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/hook", s.port);
+    char dead[64];
+    snprintf(dead, sizeof(dead), "/tmp/aquaguard_notify_test_%d.dead", (int)getpid());
+    unlink(dead);
+
+    SharedState st;
+    state_with_webhook(&st, url, dead);
+    st.notify = notify_start(&st, 6, 20);
+    ok &= expect(st.notify != NULL, "notify_start failed");
+    if (!ok) return 0;
+
+    // 10 sensors, each raising and clearing 5 times: 100 edges, in batches like the ingest paths
+    int edges = 0;
+    for (int round = 0; round < 10; round++) {
+        SensorData batch[10];
+        for (int k = 0; k < 10; k++) {
+            char id[16];
+            snprintf(id, sizeof(id), "s%d", k);
+            sample(&batch[k], id, (round & 1) ? ALERTF_NONE : ALERTF_HIGH_PRESSURE);
+            edges++;
+        }
+        state_publish_batch(&st, batch, 10);
+    }
+
+    ok &= expect(wait_stat(st.notify, "\"delivered", (unsigned long long)edges), "every edge should be delivered");
+    ok &= expect(atomic_load(&s.events) == edges, "stand-in should receive each edge exactly once");
+    ok &= expect(atomic_load(&s.connections) == 1, "requests should share one keep-alive connection");
+    ok &= expect(atomic_load(&s.requests) >= 3 && atomic_load(&s.requests) < edges, "edges should be batched");
+    ok &= expect(stat_value(st.notify, "\"retries") == 2, "two 503s should mean two retries");
+    ok &= expect(stat_value(st.notify, "\"dead_lettered") == 0, "nothing should be dead-lettered");
+    ok &= expect(access(dead, F_OK) != 0, "dead-letter file should not exist");
+
+    notify_stop(st.notify);
+    standin_stop(&s);
+    free(st.slices);
+    return ok;
+}
+
+static int test_dead_letter(void) {
+    int ok = 1;
+    // A port nobody listens on: take a free one from a stand-in and shut it down again
+    StandIn s;
+    standin_start(&s, 0);
+    int port = s.port;
+    standin_stop(&s);
+
+    char url[64], dead[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/hook", port);
+    snprintf(dead, sizeof(dead), "/tmp/aquaguard_notify_test_%d.dead", (int)getpid());
+    unlink(dead);
+
+    SharedState st;
+    state_with_webhook(&st, url, dead);
+    st.notify = notify_start(&st, 3, 10);
+    SensorData b[2];
+    sample(&b[0], "x1", ALERTF_HIGH_TEMP);
+    sample(&b[1], "x2", ALERTF_HIGH_HUMIDITY);
+    b[0].flow_lpm = NAN;             // a failed flow sensor must still produce valid JSON
+    state_publish_batch(&st, b, 2);
+
+    ok &= expect(wait_stat(st.notify, "\"dead_lettered", 2), "both edges should be dead-lettered after 3 attempts");
+    ok &= expect(stat_value(st.notify, "\"retries") == 2, "3 attempts means 2 retries");
+    notify_stop(st.notify);
+
+    FILE* f = fopen(dead, "r");
+    ok &= expect(f != NULL, "dead-letter file missing");
+    int lines = 0;
+    char line[2048];
+    while (f && fgets(line, sizeof(line), f)) {
+        lines++;
+        ok &= expect(strstr(line, url) && strstr(line, "\"attempts\": 3") && strstr(line, "\"raised\": [\"HIGH_"),
+                     "dead-letter line should carry destination, attempts and the event");
+        ok &= expect(!strstr(line, "nan") && (!strstr(line, "\"x1\"") || strstr(line, "\"flow_lpm\": null")),
+                     "a non-finite reading should be written as null");
+    }
+    if (f) fclose(f);
+    ok &= expect(lines == 2, "expected 2 dead-letter lines");
+    unlink(dead);
+    free(st.slices);
+    return ok;
+}
+
+// A receiver that accepts the connection but never answers must not hold up the others
+static int test_stalled_receiver(void) {
+    int ok = 1;
+    StandIn good;
+    standin_start(&good, 0);
+    int silent = socket(AF_INET, SOCK_STREAM, 0); // listens but never accepts or replies
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(silent, (struct sockaddr*)&addr, sizeof(addr));
+    listen(silent, 8);
+    socklen_t alen = sizeof(addr);
+    getsockname(silent, (struct sockaddr*)&addr, &alen);
+
+    char dead[64];
+    snprintf(dead, sizeof(dead), "/tmp/aquaguard_notify_test_%d.dead", (int)getpid());
+    unlink(dead);
+    SharedState st;
+    state_with_webhook(&st, "", dead);
+    snprintf(st.webhook_urls[0], sizeof(st.webhook_urls[0]), "http://127.0.0.1:%d/hook", ntohs(addr.sin_port));
+    snprintf(st.webhook_urls[1], sizeof(st.webhook_urls[1]), "http://127.0.0.1:%d/hook", good.port);
+    st.nwebhooks = 2;
+    st.notify = notify_start(&st, 6, 20);
+    ok &= expect(st.notify != NULL, "notify_start failed");
+    if (!ok) return 0;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int round = 0; round < 4; round++) {
+        SensorData batch[5];
+        for (int k = 0; k < 5; k++) {
+            char id[16];
+            snprintf(id, sizeof(id), "s%d", k);
+            sample(&batch[k], id, (round & 1) ? ALERTF_NONE : ALERTF_HIGH_TEMP);
+        }
+        state_publish_batch(&st, batch, 5);
+    }
+    for (int tries = 0; tries < 200 && atomic_load(&good.events) < 20; tries++) usleep(5000);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long ms = (t1.tv_sec - t0.tv_sec) * 1000L + (t1.tv_nsec - t0.tv_nsec) / 1000000L;
+    ok &= expect(atomic_load(&good.events) == 20, "the healthy receiver should get every edge");
+    ok &= expect(ms < NOTIFY_IO_TIMEOUT_MS / 2, "the healthy receiver should not wait out the silent one's timeout");
+
+    notify_stop(st.notify);
+    standin_stop(&good);
+    close(silent);
+    unlink(dead);
+    free(st.slices);
+    return ok;
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    int ok = 1;
+    ok &= test_detector();
+    ok &= test_full_table();
+    ok &= test_delivery();
+    ok &= test_dead_letter();
+    ok &= test_stalled_receiver();
+    if (!ok) return 1;
+    printf("notify tests passed\n");
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "json.h"
 
 static int expect(int cond, const char* msg) {
@@ -29,6 +30,13 @@ int main() {
     if (!expect(rc == 0, "flowing=false parse failed")) return 1;
     if (!expect(d.flowing == 0, "flowing flag not updated")) return 1;
 
+    // sensor_id is optional: picked up when present, kept when a later packet omits it
+    const char* named = "{ \"sensor_id\": \"site-a\", \"flow_lpm\": 3.0, \"humidity_pct\": 30.0 }\n";
+    rc = parse_sensor_json(named, &d);
+    if (!expect(rc == 0 && strcmp(d.sensor_id, "site-a") == 0, "sensor_id not parsed")) return 1;
+    rc = parse_sensor_json(stopped, &d);
+    if (!expect(rc == 0 && strcmp(d.sensor_id, "site-a") == 0, "sensor_id should be preserved")) return 1;
+
     printf("OK\n");
     return 0;
 }
@@ -45,6 +45,21 @@ int main() {
     if (!expect(rc == 0, "fourth parse failed")) return 1;
     if (!expect((d.alerts_mask & ALERTF_LOW_FLOW) != 0, "low flow alert missing")) return 1;
 
+    // sensor_id is echoed unescaped into JSON output, so quotes, backslashes and control bytes are refused
+    const char* line5 = "{ \"flow_lpm\": 1.0, \"humidity_pct\": 40.0, \"sensor_id\": \"tank-7\" }\n";
+    if (!expect(parse_sensor_json(line5, &d) == 0 && strcmp(d.sensor_id, "tank-7") == 0, "sensor_id not parsed")) return 1;
+    const char* line6 = "{ \"flow_lpm\": 99.0, \"humidity_pct\": 40.0, \"sensor_id\": \"a\\\", \\\"x\\\": \\\"b\" }\n";
+    if (!expect(parse_sensor_json(line6, &d) != 0, "sensor_id with a backslash should be rejected")) return 1;
+    const char* line7 = "{ \"flow_lpm\": 1.0, \"humidity_pct\": 40.0, \"sensor_id\": \"a\tb\" }\n";
+    if (!expect(parse_sensor_json(line7, &d) != 0, "sensor_id with a control byte should be rejected")) return 1;
+    if (!expect(strcmp(d.sensor_id, "tank-7") == 0 && (int)d.flow_lpm == 1, "rejected line must leave the reading alone")) return 1;
+    // 31 bytes fit SensorData.sensor_id; a longer id is refused rather than cut to a shared prefix
+    const char* line8 = "{ \"flow_lpm\": 2.0, \"humidity_pct\": 40.0, \"sensor_id\": \"0123456789012345678901234567890\" }\n";
+    if (!expect(parse_sensor_json(line8, &d) == 0 && strlen(d.sensor_id) == 31, "31-byte sensor_id should be accepted")) return 1;
+    const char* line9 = "{ \"flow_lpm\": 3.0, \"humidity_pct\": 40.0, \"sensor_id\": \"0123456789012345678901234567890X\" }\n";
+    if (!expect(parse_sensor_json(line9, &d) != 0 && (int)d.flow_lpm == 2, "32-byte sensor_id should be rejected")) return 1;
+    if (!expect(sensor_id_valid("site-a/pump 3") && !sensor_id_valid(""), "sensor_id_valid charset wrong")) return 1;
+
     printf("OK\n");
     return 0;
 }
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "history.h"
+#include "state.h"
+
+// Checks for the staged TCP ingest: every line fed in comes out of the publisher once and in
+// order (also when one feed overflows many batches), connection changes land between the samples
+// they were queued between, pipeline_stop drains everything still in flight, and optional fields
+// carry forward per device rather than across devices sharing the connection.
+
+#define LINES (PIPE_BATCH_MAX * 5 + 17)
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+static void state_open(SharedState* st) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) st->pin_cores[i] = -1;
+    if (state_init_history(st, LINES * 2) != 0) {
+        printf("history did not start\n");
+        exit(1);
+    }
+}
+
+static void state_close(SharedState* st) {
+    history_free(st->history);
+    free(st->history);
+}
+
+static IngestPipeline* start(SharedState* st) {
+    IngestPipeline* p = pipeline_start(st);
+    if (!p) {
+        printf("pipeline did not start\n");
+        exit(1);
+    }
+    return p;
+}
+
+// One pipeline_feed call carrying many batches' worth of lines (by count and by bytes, since
+// the padded lines overflow PIPE_LINE_BATCH_BYTES first), split mid-line across two calls.
+static int test_overflow_and_drain(void) {
+    int ok = 1;
+    SharedState st;
+    state_open(&st);
+    IngestPipeline* p = start(&st);
+
+    size_t cap = (size_t)LINES * 160;
+    char* buf = malloc(cap);
+    size_t used = 0;
+    for (int i = 0; i < LINES; i++) {
+        used += (size_t)snprintf(buf + used, cap - used,
+            "{\"sensor_id\":\"dev\",\"flow_lpm\":%d.5,\"humidity_pct\":40,\"note\":\"%080d\"}\n", i, 0);
+    }
+    pipeline_feed(p, buf, used / 2);
+    pipeline_feed(p, buf + used / 2, used - used / 2);
+    free(buf);
+    // Nothing flushed by hand: pipeline_stop must push the last partial batch and drain both rings
+    pipeline_stop(p);
+
+    static HistorySample got[LINES + 1];
+    uint64_t next = 0;
+    size_t n = history_copy(st.history, 0, got, LINES + 1, &next);
+    ok &= expect(n == LINES, "every line fed should be published once");
+    for (size_t i = 0; i < n && ok; i++) {
+        ok &= expect(got[i].flow_lpm == (float)i + 0.5f, "samples should arrive in feed order");
+    }
+    ok &= expect(st.data.last_seq == LINES, "the dashboard should count every sample");
+    state_close(&st);
+    return ok;
+}
+
+static int test_conn_order(void) {
+    int ok = 1;
+    SharedState st;
+    state_open(&st);
+    IngestPipeline* p = start(&st);
+
+    const char* a = "{\"sensor_id\":\"dev\",\"flow_lpm\":1,\"humidity_pct\":40}\n";
+    pipeline_feed(p, a, strlen(a));
+    pipeline_feed(p, a, strlen(a));
+    pipeline_feed(p, "{\"sensor_id\":\"dev\",\"flow_lpm\":99", 32); // cut off by the disconnect
+    pipeline_conn_event(p, CONN_DISCONNECTED);
+    pipeline_stop(p);
+
+    // The event was queued after the samples, so it must also be applied after them
+    ok &= expect(st.data.conn == CONN_DISCONNECTED, "disconnect should land after the samples before it");
+    ok &= expect(st.data.last_seq == 3, "two samples and one connection change expected");
+    ok &= expect(st.history->total == 2, "the half line must be dropped with the connection");
+
+    p = start(&st);
+    pipeline_conn_event(p, CONN_CONNECTED);
+    pipeline_conn_event(p, CONN_DISCONNECTED);
+    const char* b = "{\"sensor_id\":\"dev\",\"flow_lpm\":2,\"humidity_pct\":40}\n";
+    pipeline_feed(p, b, strlen(b));
+    pipeline_stop(p);
+    ok &= expect(st.data.conn == CONN_CONNECTED && st.data.flow_lpm == 2.0f,
+                 "a sample fed after the disconnect should land after it");
+    state_close(&st);
+    return ok;
+}
+
+static int test_per_device_fields(void) {
+    int ok = 1;
+    SharedState st;
+    state_open(&st);
+    IngestPipeline* p = start(&st);
+
+    const char* lines =
+        "{\"sensor_id\":\"a\",\"flow_lpm\":1,\"humidity_pct\":40,\"temperature_c\":30,\"pressure_kpa\":150}\n"
+        "{\"sensor_id\":\"b\",\"flow_lpm\":2,\"humidity_pct\":40}\n"
+        "{\"sensor_id\":\"a\",\"flow_lpm\":3,\"humidity_pct\":40}\n"
+        "{\"sensor_id\":\"b\",\"flow_lpm\":4,\"humidity_pct\":40,\"temperature_c\":12}\n"
+        "{\"flow_lpm\":5,\"humidity_pct\":40}\n";
+    pipeline_feed(p, lines, strlen(lines));
+    pipeline_stop(p);
+
+    HistorySample got[5];
+    uint64_t next = 0;
+    ok &= expect(history_copy(st.history, 0, got, 5, &next) == 5, "five samples expected");
+    ok &= expect(got[1].temperature_c == 0.0f && got[1].pressure_kpa == 0.0f &&
+                 !(got[1].alerts_mask & ALERTF_HIGH_PRESSURE),
+                 "a new device must not inherit another device's optional fields or alerts");
+    ok &= expect(got[2].temperature_c == 30.0f && got[2].pressure_kpa == 150.0f,
+                 "a device should keep its own optional fields across other devices' lines");
+    ok &= expect(strcmp(got[4].sensor_id, "b") == 0 && got[4].temperature_c == 12.0f,
+                 "a line without sensor_id continues the previous device");
+    state_close(&st);
+    return ok;
+}
+
+int main(void) {
+    int ok = 1;
+    ok &= test_overflow_and_drain();
+    ok &= test_conn_order();
+    ok &= test_per_device_fields();
+    if (!ok) return 1;
+    printf("pipeline tests passed\n");
+    return 0;
+}
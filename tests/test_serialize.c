@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "serialize.h"
+#include "sse_reference.h"
+
+// The fast serializer must produce exactly what the old snprintf formatter produced,
+// otherwise the dashboard (and anything scraping /events) would see different text.
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+static int same_as_reference(const SensorData* d) {
+    char ref[1024];
+    char out[SSE_FRAME_MAX];
+    reference_json_for_current(d, ref, sizeof(ref));
+    size_t n = json_format_current(d, out, sizeof(out));
+    if (n != strlen(ref) || memcmp(out, ref, n) != 0) {
+        printf("reference: %s\nfast:      %.*s\n", ref, (int)n, out);
+        return 0;
+    }
+    return 1;
+}
+
+int main() {
+    SensorData d = (SensorData){0};
+    snprintf(d.via, sizeof(d.via), "TCP");
+
+    // Every alert mask, both connection states
+    for (int mask = 0; mask <= ALERT_MASK_ALL; mask++) {
+        d.alerts_mask = (AlertFlags)mask;
+        d.conn = (mask & 1) ? CONN_CONNECTED : CONN_DISCONNECTED;
+        d.last_seq = (uint64_t)mask * 1000003u;
+        if (!expect(same_as_reference(&d), "alert mask output differs")) return 1;
+    }
+
+    // Rounding edge cases: exact ties, negatives that round to zero, signed zero, big values
+    const float edge[] = { 0.0f, -0.0f, 0.005f, 0.015f, 0.125f, 0.375f, 2.675f, -0.001f, -0.004999f,
+                           99.995f, 1.0f / 3.0f, 45.0f, 120.0001f, 1e7f, 123456.789f, -987654.25f,
+                           1e14f, 9.99e14f, 1e15f, 3.4e38f, -3.4e38f, NAN, INFINITY, -INFINITY, 1e-40f };
+    for (size_t i = 0; i < sizeof(edge) / sizeof(edge[0]); i++) {
+        d.flow_lpm = edge[i];
+        d.humidity_pct = -edge[i];
+        d.temperature_c = edge[i] * 0.5f;
+        d.pressure_kpa = edge[i] + 1.0f;
+        if (!expect(same_as_reference(&d), "edge value output differs")) return 1;
+    }
+
+    // A large random sweep across the ranges the sensors actually report (and beyond)
+    srand(12345);
+    for (int i = 0; i < 200000; i++) {
+        d.flow_lpm = (float)rand() / (float)RAND_MAX * 60.0f;
+        d.humidity_pct = (float)rand() / (float)RAND_MAX * 100.0f;
+        d.temperature_c = (float)rand() / (float)RAND_MAX * 200.0f - 100.0f;
+        d.pressure_kpa = (float)(rand() % 200000) / 100.0f + 0.005f;
+        d.alerts_mask = (AlertFlags)(rand() & ALERT_MASK_ALL);
+        d.last_seq = ((uint64_t)rand() << 32) | (uint64_t)rand();
+        if (!expect(same_as_reference(&d), "random value output differs")) return 1;
+    }
+
+    // The SSE frame is the JSON wrapped in "data: ...\n\n"
+    char frame[SSE_FRAME_MAX + 8];
+    char ref[1024];
+    char want[1100];
+    size_t n = sse_format_frame(&d, frame, sizeof(frame));
+    reference_json_for_current(&d, ref, sizeof(ref));
+    snprintf(want, sizeof(want), "data: %s\n\n", ref);
+    if (!expect(n == strlen(want) && memcmp(frame, want, n) == 0, "SSE frame differs")) return 1;
+    if (!expect(sse_format_frame(&d, frame, 16) == 0, "small buffer should be refused")) return 1;
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "snapshot.h"
+#include "state.h"
+#include "history.h"
+
+// Round-trip check for the warm-start snapshot: what was written on shutdown must come back
+// on startup, and a damaged file must be refused instead of restoring garbage.
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+static void init_state(SharedState* st, int slices, size_t history) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+    state_init_slices(st, slices);
+    state_init_history(st, history);
+}
+
+int main() {
+    const char* path = "test_snapshot.snap";
+    SharedState a;
+    init_state(&a, 2, 100);
+
+    // 150 samples from three devices spread over two slices (the ring keeps the last 100)
+    for (int i = 0; i < 150; i++) {
+        SensorData s;
+        memset(&s, 0, sizeof(s));
+        snprintf(s.sensor_id, sizeof(s.sensor_id), "dev-%d", i % 3);
+        s.flow_lpm = (float)i;
+        s.humidity_pct = 40.0f;
+        s.pressure_kpa = 101.0f + (float)(i % 3);
+        s.alerts_mask = (i % 3 == 1) ? ALERTF_HIGH_PRESSURE : ALERTF_NONE;
+        s.conn = CONN_CONNECTED;
+        state_publish_batch(&a, &s, 1);
+    }
+    if (!expect(snapshot_write(&a, path) == 0, "snapshot write failed")) return 1;
+
+    SharedState b;
+    init_state(&b, 1, 50);
+    if (!expect(snapshot_load(&b, path) == 0, "snapshot load failed")) return 1;
+    if (!expect(b.data.flow_lpm == 149.0f && b.data.last_seq == 150, "dashboard reading not restored")) return 1;
+    if (!expect(b.data.conn == CONN_DISCONNECTED, "restored data should start disconnected")) return 1;
+
+    SensorData devs[8];
+    RollingStats stats[8];
+    int n = state_merged_devices(&b, devs, stats, 8);
+    if (!expect(n == 3, "expected three restored devices")) return 1;
+    for (int i = 0; i < n; i++) {
+        if (!expect(devs[i].last_seq == 50 && stats[i].count == 50, "per-device seq/stats wrong")) return 1;
+        if (strcmp(devs[i].sensor_id, "dev-1") == 0) {
+            if (!expect(devs[i].alerts_mask == ALERTF_HIGH_PRESSURE, "alert mask not restored")) return 1;
+            if (!expect(stats[i].min[0] == 1.0f && stats[i].max[0] == 148.0f, "rolling min/max wrong")) return 1;
+        }
+    }
+
+    // A smaller ring keeps the newest samples
+    HistorySample recs[64];
+    size_t got = history_copy(b.history, 0, recs, 64, NULL);
+    if (!expect(got == 50 && recs[49].flow_lpm == 149.0f && recs[0].flow_lpm == 100.0f, "history not restored")) return 1;
+
+    // Flip one byte in the body: the checksum must reject the file
+    FILE* f = fopen(path, "r+b");
+    fseek(f, (long)sizeof(SnapshotHeader) + 8, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, (long)sizeof(SnapshotHeader) + 8, SEEK_SET);
+    fputc(c ^ 0xFF, f);
+    fclose(f);
+    SharedState c2;
+    init_state(&c2, 1, 10);
+    if (!expect(snapshot_load(&c2, path) != 0, "corrupt snapshot should be rejected")) return 1;
+    if (!expect(snapshot_load(&c2, "does-not-exist.snap") != 0, "missing snapshot should fail")) return 1;
+
+    remove(path);
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include "subs.h"
+#include "state.h"
+#include "serialize.h"
+
+// Checks for filtered SSE streams: filter parsing, which subscriber receives which update,
+// that identical filters share a single serialization, and that alerts_only subscribers see
+// every edge even when a raise and its clear land between two hub passes.
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+// Everything currently readable on the client side of a subscriber socket
+static const char* drain(int fd) {
+    static char buf[8192];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    buf[n > 0 ? n : 0] = 0;
+    return buf;
+}
+
+static int subscribe(SubHub* hub, const char* query) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL, 0) | O_NONBLOCK);
+    SubFilter f;
+    subs_parse_filter(query, &f);
+    subs_add(hub, sv[0], &f);
+    return sv[1];
+}
+
+static void publish(SharedState* st, const char* id, float pressure) {
+    SensorData s;
+    memset(&s, 0, sizeof(s));
+    snprintf(s.sensor_id, sizeof(s.sensor_id), "%s", id);
+    s.flow_lpm = 5.0f;
+    s.humidity_pct = 40.0f;
+    s.pressure_kpa = pressure;
+    s.alerts_mask = pressure > PRESSURE_EMERGENCY_THRESHOLD ? ALERTF_HIGH_PRESSURE : ALERTF_NONE;
+    s.conn = CONN_CONNECTED;
+    state_publish_batch(st, &s, 1);
+}
+
+static unsigned long long stat_value(SubHub* hub, const char* key) {
+    char buf[256];
+    subs_stats_json(hub, buf, sizeof(buf));
+    const char* p = strstr(buf, key);
+    return p ? strtoull(p + strlen(key) + 3, NULL, 10) : 0; // skip `": `
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN); // the gateway ignores it too; a hung-up subscriber must not kill us
+    SubFilter f;
+    if (!expect(subs_parse_filter(NULL, &f) == 0 && f.fields == FIELD_ALL, "plain /events should be unfiltered")) return 1;
+    if (!expect(subs_parse_filter("sensors=site%2Db,site-a&fields=pressure_kpa,alerts", &f) == 1, "filter parse failed")) return 1;
+    if (!expect(f.nsensors == 2 && strcmp(f.sensors[0], "site-a") == 0 && strcmp(f.sensors[1], "site-b") == 0,
+                "sensors should be decoded and sorted")) return 1;
+    if (!expect(f.fields == (FIELD_PRESSURE | FIELD_ALERTS), "fields parsed wrong")) return 1;
+    if (!expect(subs_parse_filter("alerts_only=1", &f) == 1 && f.alerts_only && f.fields == FIELD_ALERTS,
+                "alerts_only should default to alert fields")) return 1;
+    if (!expect(subs_parse_filter("fields=colour", &f) == -1, "unknown field should be rejected")) return 1;
+
+    SharedState st;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_init(&st.mu, NULL);
+    state_init_slices(&st, 1);
+    publish(&st, "a", 101.0f);
+    publish(&st, "b", 102.0f);
+    publish(&st, "c", 103.0f);
+
+    SubHub* hub = subs_create(&st);
+    st.subs = hub;                   // state_publish_batch now pushes updates to the hub
+    int wall1 = subscribe(hub, "sensors=a&fields=pressure");
+    int wall2 = subscribe(hub, "fields=pressure&sensors=a");   // same filter, other order
+    int pair = subscribe(hub, "sensors=b,a");
+    int ops = subscribe(hub, "alerts_only=1");
+    if (!expect(stat_value(hub, "\"groups") == 3, "identical filters should share a group")) return 1;
+
+    // First tick primes every subscriber with the current state of its sensors
+    subs_tick(hub);
+    const char* got = drain(wall1);
+    if (!expect(strstr(got, "\"sensor_id\": \"a\", \"pressure_kpa\": 101.00, \"seq\": 1 }") != NULL, "wall1 not primed")) return 1;
+    if (!expect(strstr(got, "flow_lpm") == NULL && strstr(got, "\"b\"") == NULL, "wall1 got unfiltered data")) return 1;
+    if (!expect(strstr(drain(wall2), "\"a\"") != NULL, "wall2 not primed")) return 1;
+    got = drain(pair);
+    if (!expect(strstr(got, "\"a\"") && strstr(got, "\"b\"") && !strstr(got, "\"c\""), "pair filter wrong")) return 1;
+    drain(ops);
+
+    // An update to "a" is serialized once for the wall group and once for the pair group
+    unsigned long long before = stat_value(hub, "\"frames_serialized");
+    publish(&st, "a", 110.0f);
+    subs_tick(hub);
+    if (!expect(stat_value(hub, "\"frames_serialized") - before == 2, "expected one serialization per group")) return 1;
+    if (!expect(strstr(drain(wall1), "110.00") && strstr(drain(wall2), "110.00"), "wall subscribers missed update")) return 1;
+    if (!expect(strstr(drain(pair), "110.00") != NULL, "pair subscriber missed update")) return 1;
+    if (!expect(drain(ops)[0] == 0, "alerts_only should ignore updates without alert change")) return 1;
+
+    // Crossing the pressure threshold reaches the ops console; updating "c" reaches nobody else
+    publish(&st, "c", 125.0f);
+    subs_tick(hub);
+    got = drain(ops);
+    if (!expect(strstr(got, "\"c\"") && strstr(got, "HIGH_PRESSURE") && !strstr(got, "pressure_kpa"), "ops alert missing")) return 1;
+    if (!expect(drain(wall1)[0] == 0 && drain(pair)[0] == 0, "unrelated sensor leaked to filtered streams")) return 1;
+
+    // Raised and cleared again before the hub runs: both edges still reach the ops console, in order
+    publish(&st, "b", 126.0f);
+    publish(&st, "b", 102.0f);
+    subs_tick(hub);
+    got = drain(ops);
+    const char* raised = strstr(got, "\"b\", \"alerts\": [\"HIGH_PRESSURE\"]");
+    const char* cleared = strstr(got, "\"b\", \"alerts\": []");
+    if (!expect(raised && cleared && raised < cleared, "a short-lived alert should reach alerts_only subscribers")) return 1;
+    // The pair subscriber only wants the newest state of "b"
+    got = drain(pair);
+    if (!expect(strstr(got, "102.00") && !strstr(got, "126.00"), "plain subscribers should get the coalesced update")) return 1;
+
+    // A subscriber that hung up is dropped on the next send
+    close(wall2);
+    publish(&st, "a", 111.0f);
+    subs_tick(hub);
+    subs_tick(hub);
+    if (!expect(stat_value(hub, "\"subscribers") == 3, "closed subscriber should be pruned")) return 1;
+
+    st.subs = NULL;
+    subs_destroy(hub);
+    printf("OK\n");
+    return 0;
+}
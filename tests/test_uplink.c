@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "uplink.h"
+#include "ingest.h"
+#include "state.h"
+#include "history.h"
+
+// Checks for gateway federation: the batch codec round-trips bit for bit, acks queue instead
+// of blocking when the edge does not read them, several edge gateways on
+// localhost feed one aggregator without loss or duplicates, and batches spilled while the
+// aggregator is down arrive once it comes back.
+
+#define GATEWAYS 3
+#define SENSORS_PER_GATEWAY 4
+#define SAMPLES_PER_SENSOR 500
+
+static int expect(int cond, const char* msg) {
+    if (!cond) {
+        printf("%s\n", msg);
+        return 0;
+    }
+    return 1;
+}
+
+static void make_sample(SensorData* s, const char* id, int i) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->sensor_id, sizeof(s->sensor_id), "%s", id);
+    s->flow_lpm = (float)(i % 50) + 0.25f;
+    s->humidity_pct = 40.0f + (float)(i % 7) * 0.5f;
+    s->temperature_c = -5.0f + (float)(i % 13);
+    s->pressure_kpa = 101.3f;
+    s->flowing = (i % 3) != 0;
+    s->alerts_mask = (AlertFlags)(i & 0x1F);
+    s->conn = CONN_CONNECTED;
+}
+
+static int test_codec(void) {
+    int ok = 1;
+    static UplinkSample in[UPLINK_BATCH_MAX], out[UPLINK_BATCH_MAX];
+    static unsigned char buf[UPLINK_PAYLOAD_MAX];
+    for (int i = 0; i < UPLINK_BATCH_MAX; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "sensor-%d", i % 20);
+        make_sample(&in[i].s, id, i);
+        in[i].ts_ms = 1700000000000ull + (uint64_t)i * 7;
+    }
+    // Readings that are not exact hundredths travel as float bit-pattern deltas
+    in[5].s.pressure_kpa = NAN;
+    in[6].s.flow_lpm = -12345.67f;
+    in[7].s.flow_lpm = 45.004f;      // just over a threshold; must not round onto it
+    in[8].s.temperature_c = -0.0f;
+    in[9].s.humidity_pct = INFINITY;
+    in[10].s.pressure_kpa = 3.0e20f;
+    in[11].s.temperature_c = 21.123456f;
+
+    int used = 0;
+    size_t len = uplink_encode(in, UPLINK_BATCH_MAX, buf, sizeof(buf), &used);
+    ok &= expect(used == UPLINK_BATCH_MAX && len > 0, "encode should take the whole batch");
+    ok &= expect(len < (size_t)UPLINK_BATCH_MAX * 16, "batch should compress to under 16 bytes/sample");
+    ok &= expect(uplink_decode(buf, len, out, UPLINK_BATCH_MAX) == UPLINK_BATCH_MAX, "decode should return every sample");
+    for (int i = 0; i < UPLINK_BATCH_MAX && ok; i++) {
+        const SensorData *a = &in[i].s, *b = &out[i].s;
+        ok &= expect(in[i].ts_ms == out[i].ts_ms, "timestamp mismatch");
+        ok &= expect(strcmp(a->sensor_id, b->sensor_id) == 0, "sensor_id mismatch");
+        const float va[4] = { a->flow_lpm, a->humidity_pct, a->temperature_c, a->pressure_kpa };
+        const float vb[4] = { b->flow_lpm, b->humidity_pct, b->temperature_c, b->pressure_kpa };
+        ok &= expect(memcmp(va, vb, sizeof(va)) == 0, "readings should round-trip bit for bit");
+        ok &= expect(a->alerts_mask == b->alerts_mask && a->flowing == b->flowing && b->conn == CONN_CONNECTED, "flags mismatch");
+        ok &= expect(strcmp(b->via, "UPLINK") == 0, "decoded samples should say via UPLINK");
+    }
+
+    ok &= expect(uplink_decode(buf, len - 1, out, UPLINK_BATCH_MAX) == -1, "truncated payload must be rejected");
+    ok &= expect(uplink_decode(buf, len, out, 10) == -1, "payload larger than max must be rejected");
+
+    // Only 255 distinct sensors fit the per-batch id table
+    for (int i = 0; i < 300; i++) snprintf(in[i].s.sensor_id, sizeof(in[i].s.sensor_id), "dev-%d", i);
+    uplink_encode(in, 300, buf, sizeof(buf), &used);
+    ok &= expect(used == 255, "a batch should stop at 255 distinct sensors");
+    return ok;
+}
+
+static void put_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// An edge that stops reading acks must not stall the aggregator: with the socket full the
+// ack is queued, newer acks coalesce into it, and uplink_rx_flush sends it once there is room.
+static int test_ack_queue(void) {
+    int ok = 1;
+    SharedState st;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_init(&st.mu, NULL);
+    st.uplink_peers = uplink_peers_create();
+    state_init_slices(&st, 1);
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return expect(0, "socketpair failed");
+    int sz = 4096;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    char junk[1024];
+    memset(junk, 0, sizeof(junk));
+    while (write(sv[0], junk, sizeof(junk)) > 0) {}
+    // Partial writes can leave a little room; fill it byte by byte
+    while (write(sv[0], junk, 1) > 0) {}
+
+    UplinkRx rx;
+    memset(&rx, 0, sizeof(rx));
+    rx.peer = -1;
+    unsigned char hello[5 + 8 + 8];
+    memcpy(hello, UPLINK_MAGIC_HELLO, 4);
+    hello[4] = 8;
+    memcpy(hello + 5, "edge-ack", 8);
+    put_le(hello + 13, 1, 8);
+    ok &= expect(uplink_rx_feed(&st, 0, &rx, sv[0], (const char*)hello, sizeof(hello)) == 0, "hello rejected");
+
+    static unsigned char frame[UPLINK_BATCH_HDR + 256];
+    UplinkSample one;
+    make_sample(&one.s, "s1", 1);
+    one.ts_ms = 1700000000000ull;
+    for (uint64_t seq = 1; seq <= 3; seq++) {
+        int used = 0;
+        size_t len = uplink_encode(&one, 1, frame + UPLINK_BATCH_HDR, 256, &used);
+        memcpy(frame, UPLINK_MAGIC_BATCH, 4);
+        put_le(frame + 4, len, 4);
+        put_le(frame + 8, seq, 8);
+        put_le(frame + 16, 1, 4);
+        ok &= expect(uplink_rx_feed(&st, 0, &rx, sv[0], (const char*)frame, UPLINK_BATCH_HDR + len) == 0,
+                     "a full socket must not fail the batch");
+    }
+    ok &= expect(uplink_rx_want_write(&rx), "the ack should be queued while the socket is full");
+
+    // Drain the edge side, then flush: the queued ack plus the newest cumulative one arrive
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    static unsigned char got[1 << 20];
+    size_t have = 0;
+    for (int round = 0; round < 200 && uplink_rx_want_write(&rx); round++) {
+        ssize_t n;
+        while ((n = read(sv[1], got + have, sizeof(got) - have)) > 0) have += (size_t)n;
+        ok &= expect(uplink_rx_flush(&rx, sv[0]) == 0, "flush failed");
+    }
+    ssize_t n;
+    while ((n = read(sv[1], got + have, sizeof(got) - have)) > 0) have += (size_t)n;
+    ok &= expect(!uplink_rx_want_write(&rx), "the queued ack should have been flushed");
+    ok &= expect(have >= UPLINK_ACK_LEN && memcmp(got + have - UPLINK_ACK_LEN, UPLINK_MAGIC_ACK, 4) == 0 &&
+                 got[have - UPLINK_ACK_LEN + 4] == 3, "the last ack should cover the newest batch");
+
+    uplink_rx_close(&st, &rx);
+    close(sv[0]);
+    close(sv[1]);
+    uplink_peers_free(st.uplink_peers);
+    free(st.slices);
+    return ok;
+}
+
+static void aggregator_start(SharedState* st, int port) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+    st->mode = MODE_LISTEN;
+    st->nshards = 2;
+    st->ingest_port = port;
+    st->uplink_peers = uplink_peers_create();
+    if (state_init_slices(st, 2) != 0 || ingest_start(st) != 0) {
+        printf("aggregator did not start\n");
+        exit(1);
+    }
+}
+
+static void aggregator_stop(SharedState* st) {
+    ingest_stop(st);
+    uplink_peers_free(st->uplink_peers);
+    free(st->slices);
+}
+
+static void edge_init(SharedState* st) {
+    memset(st, 0, sizeof(*st));
+    pthread_mutex_init(&st->mu, NULL);
+}
+
+static void edge_publish(SharedState* st, int gw) {
+    SensorData batch[50];
+    for (int i = 0; i < SAMPLES_PER_SENSOR * SENSORS_PER_GATEWAY; i += 50) {
+        for (int k = 0; k < 50; k++) {
+            char id[32];
+            snprintf(id, sizeof(id), "gw%d-s%d", gw, (i + k) % SENSORS_PER_GATEWAY);
+            make_sample(&batch[k], id, i + k);
+        }
+        state_publish_batch(st, batch, 50);
+    }
+}
+
+// Wait until the aggregator holds `want` devices that each saw exactly `per_device` samples
+static int wait_for_devices(SharedState* agg, int want, uint64_t per_device) {
+    SensorData devs[64];
+    for (int tries = 0; tries < 200; tries++) {
+        int n = state_merged_devices(agg, devs, NULL, 64);
+        int done = 0;
+        for (int i = 0; i < n; i++) done += devs[i].last_seq == per_device;
+        if (n == want && done == want) return 1;
+        usleep(50000);
+    }
+    return 0;
+}
+
+static int test_federation(void) {
+    int ok = 1;
+    SharedState agg, edges[GATEWAYS];
+    aggregator_start(&agg, 0);
+
+    for (int g = 0; g < GATEWAYS; g++) {
+        char id[32];
+        snprintf(id, sizeof(id), "edge-%d", g);
+        edge_init(&edges[g]);
+        edges[g].uplink = uplink_start(&edges[g], "127.0.0.1", agg.ingest_port, id, "", UPLINK_SPILL_DEFAULT);
+        ok &= expect(edges[g].uplink != NULL, "uplink_start failed");
+    }
+    if (!ok) return 0;
+    for (int g = 0; g < GATEWAYS; g++) edge_publish(&edges[g], g);
+
+    ok &= expect(wait_for_devices(&agg, GATEWAYS * SENSORS_PER_GATEWAY, SAMPLES_PER_SENSOR),
+                 "aggregator should hold every edge sensor with all of its samples");
+
+    UplinkPeer peers[8];
+    int np = uplink_peers_snapshot(agg.uplink_peers, peers, 8);
+    ok &= expect(np == GATEWAYS, "aggregator should list one peer per gateway");
+    for (int i = 0; i < np; i++) {
+        ok &= expect(peers[i].samples == SAMPLES_PER_SENSOR * SENSORS_PER_GATEWAY, "peer sample count mismatch");
+        ok &= expect(peers[i].connections == 1, "each peer should have one connection");
+    }
+
+    char json[1024];
+    ok &= expect(uplink_stats_json(edges[0].uplink, json, sizeof(json)) > 0 && strstr(json, "\"connected\": 1"),
+                 "edge stats should report the connection");
+    for (int g = 0; g < GATEWAYS; g++) uplink_stop(edges[g].uplink);
+    aggregator_stop(&agg);
+    return ok;
+}
+
+// Edges in TCP or SIM mode all call their device "default": the aggregator must keep them apart
+static int test_shared_ids(void) {
+    int ok = 1;
+    SharedState agg, edges[3];
+    aggregator_start(&agg, 0);
+    const char* names[3] = { "site-a", "site-b", "a-gateway-with-a-very-long-name" };
+    for (int g = 0; g < 3; g++) {
+        edge_init(&edges[g]);
+        edges[g].uplink = uplink_start(&edges[g], "127.0.0.1", agg.ingest_port, names[g], "", UPLINK_SPILL_DEFAULT);
+        SensorData batch[10];
+        for (int k = 0; k < 10; k++) make_sample(&batch[k], g == 2 ? "sensor-with-a-long-id" : "default", k);
+        state_publish_batch(&edges[g], batch, 10);
+    }
+    ok &= expect(wait_for_devices(&agg, 3, 10), "each edge's device should stay separate on the aggregator");
+
+    SensorData devs[8];
+    int n = state_merged_devices(&agg, devs, NULL, 8);
+    int a = 0, b = 0, hashed = 0;
+    for (int i = 0; i < n; i++) {
+        a += strcmp(devs[i].sensor_id, "site-a/default") == 0;
+        b += strcmp(devs[i].sensor_id, "site-b/default") == 0;
+        hashed += strncmp(devs[i].sensor_id, "a-gateway-with-a-very-", 22) == 0 && devs[i].sensor_id[22] == '~' &&
+                  strlen(devs[i].sensor_id) == 31;
+    }
+    ok &= expect(a == 1 && b == 1, "devices should be named <uplink id>/<sensor_id>");
+    ok &= expect(hashed == 1, "an over-long name should be shortened with a hash suffix");
+    for (int g = 0; g < 3; g++) uplink_stop(edges[g].uplink);
+    aggregator_stop(&agg);
+    return ok;
+}
+
+static int test_spill_replay(void) {
+    int ok = 1;
+    char spill[64];
+    snprintf(spill, sizeof(spill), "/tmp/aquaguard_uplink_test_%d.spill", (int)getpid());
+    unlink(spill);
+
+    // Learn a free port, then take the aggregator down again
+    SharedState agg;
+    aggregator_start(&agg, 0);
+    int port = agg.ingest_port;
+    aggregator_stop(&agg);
+
+    SharedState edge;
+    edge_init(&edge);
+    edge.uplink = uplink_start(&edge, "127.0.0.1", port, "edge-spill", spill, UPLINK_SPILL_DEFAULT);
+    edge_publish(&edge, 9);
+
+    char json[1024];
+    int spilled = 0;
+    for (int tries = 0; tries < 100 && !spilled; tries++) {
+        usleep(20000);
+        uplink_stats_json(edge.uplink, json, sizeof(json));
+        spilled = uplink_queued(edge.uplink) == 0 && strstr(json, "\"spill_bytes\": 0,") == NULL;
+    }
+    ok &= expect(spilled, "batches should go to the spill file while the aggregator is down");
+
+    aggregator_start(&agg, port);
+    ok &= expect(wait_for_devices(&agg, SENSORS_PER_GATEWAY, SAMPLES_PER_SENSOR),
+                 "spilled batches should be replayed once the aggregator is back");
+    uplink_stats_json(edge.uplink, json, sizeof(json));
+    ok &= expect(strstr(json, "\"spill_bytes\": 0,") != NULL, "spill file should be empty after replay");
+
+    uplink_stop(edge.uplink);
+    aggregator_stop(&agg);
+    unlink(spill);
+    return ok;
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    int ok = 1;
+    ok &= test_codec();
+    ok &= test_ack_queue();
+    ok &= test_federation();
+    ok &= test_shared_ids();
+    ok &= test_spill_replay();
+    if (!ok) return 1;
+    printf("uplink tests passed\n");
+    return 0;
+}